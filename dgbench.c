@@ -0,0 +1,407 @@
+/*
+* @Author: Yinlong Su
+* @Date:   2015-11-03 10:12:45
+* @Last Modified by:   Yinlong Su
+* @Last Modified time: 2015-11-03 18:30:21
+*
+* File:         dgbench.c
+* Description:  Datagram Microbenchmark C file
+*/
+
+#include "udpfile.h"
+#include "dgbuffer.h"
+
+#define BENCH_WND       64          // receive window of the buffer benchmarks
+#define BENCH_PERMS     16          // random arrival orders, used in turn
+#define BENCH_DUPS      20          // duplicate ACKs of a storm
+#define BENCH_FILESIZE  (4 * 1024 * 1024)
+
+// sender window of dgserv.c
+extern FILE     *fp;
+extern struct file_cache *fcache;
+extern off_t    buff_off;
+extern char     buff_eof;
+extern uint32_t buff_seq;
+extern struct sender_window *swnd_head, *swnd_now, *swnd_tail;
+extern struct dg_slab *swnd_slab;
+void Dg_serv_buffer(int);
+
+extern int      tr_level;
+
+struct bench {
+    char        *name;
+    uint64_t    (*run)(uint64_t);   /* run about n operations, return # operations */
+    uint64_t    n;
+};
+
+int             bench_perm[BENCH_PERMS][BENCH_WND];
+unsigned short  bench_seed[3] = { 0x330E, 1, 0 };
+
+/* --------------------------------------------------------------------------
+ *  usage
+ *
+ *  Print usage
+ *
+ *  @param  : void
+ *  @return : void
+ * --------------------------------------------------------------------------
+ */
+void usage() {
+    printf("Usage: dgbench [-r rounds] [-s scale] [-b baseline] [-t pct] [name ...]\n");
+    printf("Options:\n");
+    printf("  -r       rounds of every benchmark, the best one is reported (default 5)\n");
+    printf("  -s       multiply the operations of every round\n");
+    printf("  -b       compare with the output of an earlier run\n");
+    printf("  -t       percent slower than the baseline that is a regression (default 10)\n");
+    printf("  -h       display this help\n");
+    printf("Only the benchmarks starting with one of the names are run.\n");
+
+    exit(0);
+}
+
+uint64_t bench_now() {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/* --------------------------------------------------------------------------
+ *  bench_rcvbuf
+ *
+ *  Receive buffer benchmark
+ *
+ *  @param  : uint64_t  n       # datagrams
+ *            int       order   # 0 = in order, 1 = reversed, 2 = random
+ *  @return : uint64_t  # datagrams written and read
+ *
+ *  Fill the receive window from the frame pool in the given order, as
+ *  RecvDgBatch does, then read every in-order datagram and give its frame
+ *  back, as the print thread does. One operation is one datagram written
+ *  and read
+ * --------------------------------------------------------------------------
+ */
+uint64_t bench_rcvbuf(uint64_t n, int order) {
+    dg_rcv_buf  *buf = CreateDgRcvBuf(BENCH_WND);
+    struct filedatagram *frame;
+    uint32_t    base = 1, ack;
+    uint64_t    done = 0;
+    int         i, k, *perm, r;
+
+    // the first datagram sets the first sequence number
+    frame = GetDgRcvFrame(buf);
+    bzero(frame, DATAGRAM_HEADERSIZE);
+    frame->seq = base++;
+    WriteDgRcvBuf(buf, frame, 0, &ack);
+    if (ReadDgRcvBuf(buf, &frame, 1) >= 0)
+        FreeDgRcvFrame(buf, frame);
+
+    for (k = 0; done < n; k++) {
+        perm = bench_perm[k % BENCH_PERMS];
+        for (i = 0; i < BENCH_WND; i++) {
+            frame = GetDgRcvFrame(buf);
+            bzero(frame, DATAGRAM_HEADERSIZE);
+            frame->len = DATAGRAM_DATASIZE;
+            if (order == 0)
+                frame->seq = base + i;
+            else if (order == 1)
+                frame->seq = base + BENCH_WND - 1 - i;
+            else
+                frame->seq = base + perm[i];
+            r = WriteDgRcvBuf(buf, frame, 0, &ack);
+            if (r != 0 && r != DGBUF_SEGMENT_OUTOFORDER)
+                FreeDgRcvFrame(buf, frame);
+        }
+        while (ReadDgRcvBuf(buf, &frame, 1) >= 0) {
+            FreeDgRcvFrame(buf, frame);
+            done ++;
+        }
+        base += BENCH_WND;
+    }
+
+    DestroyDgRcvBuf(buf);
+    return done;
+}
+
+uint64_t bench_rcvbuf_inorder(uint64_t n) {
+    return bench_rcvbuf(n, 0);
+}
+
+uint64_t bench_rcvbuf_reversed(uint64_t n) {
+    return bench_rcvbuf(n, 1);
+}
+
+uint64_t bench_rcvbuf_random(uint64_t n) {
+    return bench_rcvbuf(n, 2);
+}
+
+/* --------------------------------------------------------------------------
+ *  bench_fifo
+ *
+ *  FIFO benchmark
+ *
+ *  @param  : uint64_t  n       # datagrams
+ *  @return : uint64_t  # datagrams passed through the fifo
+ *
+ *  A producer thread writes datagrams with WriteDgFifo while this thread
+ *  reads them with ReadDgFifo, both yield when the fifo is full or empty
+ * --------------------------------------------------------------------------
+ */
+static void *bench_fifo_producer(void *arg) {
+    dg_fifo     *fifo = ((void **)arg)[0];
+    uint64_t    n = *(uint64_t *)((void **)arg)[1], i;
+    struct filedatagram dg;
+
+    bzero(&dg, sizeof(dg));
+    for (i = 0; i < n; i++) {
+        dg.seq = i;
+        while (WriteDgFifo(fifo, &dg, sizeof(dg)) < 0)
+            sched_yield();
+    }
+    return NULL;
+}
+
+uint64_t bench_fifo(uint64_t n) {
+    dg_fifo     *fifo = CreateDgFifo(FIFO_SIZE);
+    struct filedatagram dg;
+    pthread_t   tid;
+    void        *arg[2] = { fifo, &n };
+    uint64_t    done = 0;
+    int         size;
+
+    Pthread_create(&tid, NULL, bench_fifo_producer, arg);
+    while (done < n) {
+        if (ReadDgFifo(fifo, &dg, &size) < 0)
+            sched_yield();
+        else
+            done ++;
+    }
+    Pthread_join(tid, NULL);
+
+    DestroyDgFifo(fifo);
+    return done;
+}
+
+/* --------------------------------------------------------------------------
+ *  bench_cc_ack
+ *
+ *  Congestion control benchmark
+ *
+ *  @param  : uint64_t  n       # ACKs
+ *  @return : uint64_t  # ACKs handled by cc_ack
+ *
+ *  Every new ACK is followed by a storm of BENCH_DUPS duplicates, which
+ *  enters fast recovery and inflates cwnd until the next new ACK
+ * --------------------------------------------------------------------------
+ */
+uint64_t bench_cc_ack(uint64_t n) {
+    uint64_t    done = 0;
+    uint32_t    seq = 1;
+    uint8_t     fr_flag;
+    int         i;
+
+    cc_init(BENCH_WND, BENCH_WND);
+    while (done < n) {
+        cc_ack(++seq, BENCH_WND, 0, &fr_flag);
+        for (i = 0; i < BENCH_DUPS; i++)
+            cc_ack(seq, BENCH_WND, 0, &fr_flag);
+        done += 1 + BENCH_DUPS;
+    }
+    return done;
+}
+
+/* --------------------------------------------------------------------------
+ *  bench_serv_buffer
+ *
+ *  Sender window fill benchmark
+ *
+ *  @param  : uint64_t  n       # datagrams
+ *            int       cached  # 1 to copy from the file cache, 0 to fread
+ *  @return : uint64_t  # datagrams buffered by Dg_serv_buffer
+ *
+ *  Buffer a window at a time and give the nodes back to the slab, as if
+ *  the window was ACKed at once, starting over at the end of the file
+ * --------------------------------------------------------------------------
+ */
+uint64_t bench_serv_buffer(uint64_t n, int cached) {
+    static struct file_cache cache;
+    struct sender_window *swnd, *next;
+    char        *data;
+    uint64_t    done = 0;
+
+    data = Malloc(BENCH_FILESIZE);
+    memset(data, 'x', BENCH_FILESIZE);
+    if (cached) {
+        bzero(&cache, sizeof(cache));
+        cache.addr = data;
+        cache.size = BENCH_FILESIZE;
+        fcache = &cache;
+    } else {
+        fp = tmpfile();
+        if (fp == NULL || fwrite(data, 1, BENCH_FILESIZE, fp) != BENCH_FILESIZE)
+            err_sys("dgbench: can not write the temporary file");
+        rewind(fp);
+    }
+    swnd_slab = sl_create(sizeof(struct sender_window), 0);
+
+    while (done < n) {
+        Dg_serv_buffer(BENCH_WND);
+        for (swnd = swnd_head; swnd != NULL; swnd = next) {
+            next = swnd->next;
+            sl_free(swnd_slab, swnd);
+            done ++;
+        }
+        swnd_head = swnd_now = swnd_tail = NULL;
+        if (buff_eof) {
+            buff_off = 0;
+            buff_eof = 0;
+            if (fp)
+                rewind(fp);
+        }
+    }
+
+    sl_destroy(swnd_slab);
+    swnd_slab = NULL;
+    if (fp)
+        Fclose(fp);
+    fp = NULL;
+    fcache = NULL;
+    buff_off = buff_eof = buff_seq = 0;
+    free(data);
+    return done;
+}
+
+uint64_t bench_serv_buffer_cache(uint64_t n) {
+    return bench_serv_buffer(n, 1);
+}
+
+uint64_t bench_serv_buffer_fread(uint64_t n) {
+    return bench_serv_buffer(n, 0);
+}
+
+struct bench benches[] = {
+    { "rcvbuf_inorder",     bench_rcvbuf_inorder,       1000000 },
+    { "rcvbuf_reversed",    bench_rcvbuf_reversed,      1000000 },
+    { "rcvbuf_random",      bench_rcvbuf_random,        1000000 },
+    { "fifo_copy",          bench_fifo,                 1000000 },
+    { "cc_ack_dupstorm",    bench_cc_ack,               10000000 },
+    { "serv_buffer_cache",  bench_serv_buffer_cache,    1000000 },
+    { "serv_buffer_fread",  bench_serv_buffer_fread,    1000000 },
+    { NULL, NULL, 0 }
+};
+
+/* --------------------------------------------------------------------------
+ *  bench_baseline
+ *
+ *  Find a benchmark in the output of an earlier run
+ *
+ *  @param  : FILE  *in     # baseline, NULL if none
+ *            char  *name
+ *  @return : double    # ns/op of the baseline, 0 if not found
+ * --------------------------------------------------------------------------
+ */
+double bench_baseline(FILE *in, char *name) {
+    char    line[256], bname[64];
+    double  ns;
+
+    if (in == NULL)
+        return 0;
+    rewind(in);
+    while (fgets(line, sizeof(line), in) != NULL) {
+        if (line[0] == '#')
+            continue;
+        if (sscanf(line, "%63s %*s %lf", bname, &ns) == 2 && strcmp(bname, name) == 0)
+            return ns;
+    }
+    return 0;
+}
+
+int bench_selected(char *name, int argc, char **argv) {
+    int i;
+
+    if (argc == 0)
+        return 1;
+    for (i = 0; i < argc; i++)
+        if (strncmp(name, argv[i], strlen(argv[i])) == 0)
+            return 1;
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    struct bench *b;
+    FILE        *base = NULL;
+    double      scale = 1.0, tolerance = 10.0, ns, best, base_ns;
+    uint64_t    ops, t;
+    int         c, i, j, k, rounds = 5, regressions = 0;
+
+    while ((c = getopt(argc, argv, "r:s:b:t:h?")) != -1) {
+        switch (c) {
+        case 'r':
+            rounds = max(atoi(optarg), 1);
+            break;
+        case 's':
+            scale = atof(optarg);
+            break;
+        case 'b':
+            if ((base = fopen(optarg, "r")) == NULL)
+                err_sys("dgbench: can not open %s", optarg);
+            break;
+        case 't':
+            tolerance = atof(optarg);
+            break;
+        default:
+            usage();
+            break;
+        }
+    }
+
+    // the benchmarks do not print their events or export statistics
+    tr_level = TR_QUIET;
+    tr_init(NULL, getpid());
+    st_init("bench", "", "");
+
+    // random arrival orders of a window
+    for (k = 0; k < BENCH_PERMS; k++) {
+        for (i = 0; i < BENCH_WND; i++)
+            bench_perm[k][i] = i;
+        for (i = BENCH_WND - 1; i > 0; i--) {
+            j = erand48(bench_seed) * (i + 1);
+            c = bench_perm[k][i];
+            bench_perm[k][i] = bench_perm[k][j];
+            bench_perm[k][j] = c;
+        }
+    }
+
+    printf("# benchmark          operations      ns/op      Mop/s%s\n", base ? "   baseline   change" : "");
+    for (b = benches; b->name != NULL; b++) {
+        if (!bench_selected(b->name, argc - optind, argv + optind))
+            continue;
+
+        // the fastest round is the least disturbed one
+        best = 0;
+        ops = 0;
+        for (i = 0; i < rounds; i++) {
+            t = bench_now();
+            ops = b->run(b->n * scale);
+            t = bench_now() - t;
+            ns = ops ? (double)t / ops : 0;
+            if (i == 0 || ns < best)
+                best = ns;
+        }
+
+        printf("%-20s %10lu %10.2f %10.2f", b->name, ops, best, best > 0 ? 1000 / best : 0);
+        if ((base_ns = bench_baseline(base, b->name)) > 0) {
+            printf(" %10.2f %+7.1f%%", base_ns, (best - base_ns) * 100 / base_ns);
+            if (best > base_ns * (1 + tolerance / 100)) {
+                printf(" REGRESSION");
+                regressions ++;
+            }
+        }
+        printf("\n");
+        fflush(stdout);
+    }
+
+    if (base)
+        fclose(base);
+    return regressions ? 1 : 0;
+}
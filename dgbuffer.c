@@ -25,6 +25,10 @@ dg_fifo *CreateDgFifo(int size)
     fifo->head = NULL;
     fifo->curData = NULL;
 
+    // nodes come from a slab, no malloc per datagram
+    fifo->nodes = sl_create(sizeof(dg_node), 0);
+    fifo->datas = sl_create(sizeof(struct filedatagram), 0);
+
     // initial mutex
     Pthread_mutex_init(&fifo->mutex, NULL);
 
@@ -39,47 +43,37 @@ void DestroyDgFifo(dg_fifo *fifo)
     // destroy mutex
     pthread_mutex_destroy(&fifo->mutex);
 
-    // free the list nodes
-    dg_node *node = fifo->head;
-    for (; node != NULL; node = node->next)
+    // free the list nodes, pushed data is owned by the caller
+    dg_node *node = fifo->head, *next;
+    for (; node != NULL; node = next)
     {
-        if (node->data)
+        next = node->next;
+        if (node->copied == DGFIFO_COPY_HEAP && node->data)
             free(node->data);
     }
+    sl_destroy(fifo->nodes);
+    sl_destroy(fifo->datas);
 
     // free dg_fifo object
     free(fifo);
     fifo = NULL;
 }
 
-void DgLock(pthread_mutex_t mutex)
+// the mutex is passed by pointer, locking a copy does not exclude anyone
+void DgLock(pthread_mutex_t *mutex)
 {
     // lock
-    Pthread_mutex_lock(&mutex);
+    Pthread_mutex_lock(mutex);
 }
 
-void DgUnlock(pthread_mutex_t mutex)
+void DgUnlock(pthread_mutex_t *mutex)
 {
-    Pthread_mutex_unlock(&mutex);
+    Pthread_mutex_unlock(mutex);
 }
 
-int WriteDgFifo(dg_fifo *fifo, const void *data, int dataSize)
+// append a node to the fifo tail
+static int AppendDgFifo(dg_fifo *fifo, dg_node *node)
 {
-    if (fifo->curSize == fifo->size)
-    {
-        // fifo is full
-        return -1;
-    }
-
-    // lock
-    DgLock(fifo->mutex);
-
-    // create node data
-    dg_node *node = malloc(sizeof(dg_node));
-    node->data = malloc(dataSize);
-    memcpy(node->data, data, dataSize);
-    node->size = dataSize;
-
     if (fifo->curSize == 0)
     {
         fifo->head = node;
@@ -96,10 +90,73 @@ int WriteDgFifo(dg_fifo *fifo, const void *data, int dataSize)
 
     fifo->curSize++;
 
+    return fifo->curSize;
+}
+
+// remove the head node from the fifo
+static dg_node *RemoveDgFifo(dg_fifo *fifo)
+{
+    dg_node *node = fifo->head;
+
+    fifo->head = fifo->head->next;
+    fifo->curSize--;
+
+    return node;
+}
+
+int WriteDgFifo(dg_fifo *fifo, const void *data, int dataSize)
+{
+    if (fifo->curSize == fifo->size)
+    {
+        // fifo is full
+        return -1;
+    }
+
+    // create node data
+    dg_node *node = sl_alloc(fifo->nodes);
+    if (dataSize <= (int)sizeof(struct filedatagram))
+    {
+        node->data = sl_alloc(fifo->datas);
+        node->copied = DGFIFO_COPY_SLAB;
+    }
+    else
+    {
+        node->data = malloc(dataSize);
+        node->copied = DGFIFO_COPY_HEAP;
+    }
+    memcpy(node->data, data, dataSize);
+    node->size = dataSize;
+
+    // lock
+    DgLock(&fifo->mutex);
+    int ret = AppendDgFifo(fifo, node);
     // unlock
-    DgUnlock(fifo->mutex);
+    DgUnlock(&fifo->mutex);
 
-    return fifo->curSize;
+    return ret;
+}
+
+int PushDgFifo(dg_fifo *fifo, void *data, int dataSize)
+{
+    if (fifo->curSize == fifo->size)
+    {
+        // fifo is full
+        return -1;
+    }
+
+    // the node only refers to the data
+    dg_node *node = sl_alloc(fifo->nodes);
+    node->data = data;
+    node->size = dataSize;
+    node->copied = DGFIFO_COPY_NONE;
+
+    // lock
+    DgLock(&fifo->mutex);
+    int ret = AppendDgFifo(fifo, node);
+    // unlock
+    DgUnlock(&fifo->mutex);
+
+    return ret;
 }
 
 int ReadDgFifo(dg_fifo *fifo, void *data, int *dataSize)
@@ -111,25 +168,44 @@ int ReadDgFifo(dg_fifo *fifo, void *data, int *dataSize)
     }
 
     // lock
-    DgLock(fifo->mutex);
-
-    dg_node *node = fifo->head;
-
-    fifo->head = fifo->head->next;
+    DgLock(&fifo->mutex);
+    dg_node *node = RemoveDgFifo(fifo);
+    int ret = fifo->curSize;
+    // unlock
+    DgUnlock(&fifo->mutex);
 
     // copy data
     memcpy(data, node->data, node->size);
     *dataSize = node->size;
 
-    free(node->data);
-    free(node);
+    if (node->copied == DGFIFO_COPY_HEAP)
+        free(node->data);
+    else if (node->copied == DGFIFO_COPY_SLAB)
+        sl_free(fifo->datas, node->data);
+    sl_free(fifo->nodes, node);
 
-    fifo->curSize--;
+    return ret;
+}
+
+void *PopDgFifo(dg_fifo *fifo, int *dataSize)
+{
+    if (fifo->curSize == 0)
+    {
+        // fifo is empty
+        return NULL;
+    }
 
+    // lock
+    DgLock(&fifo->mutex);
+    dg_node *node = RemoveDgFifo(fifo);
     // unlock
-    DgUnlock(fifo->mutex);
+    DgUnlock(&fifo->mutex);
 
-    return fifo->curSize;
+    void *data = node->data;
+    *dataSize = node->size;
+    sl_free(fifo->nodes, node);
+
+    return data;
 }
 
 bool DgFifoEmpty(dg_fifo *fifo)
@@ -137,7 +213,7 @@ bool DgFifoEmpty(dg_fifo *fifo)
     if (fifo == NULL)
         return false;
 
-    return (fifo->curSize == fifo->size);
+    return (fifo->curSize == 0);
 }
 
 bool DgFifoFull(dg_fifo *fifo)
@@ -145,7 +221,7 @@ bool DgFifoFull(dg_fifo *fifo)
     if (fifo == NULL)
         return false;
 
-    return (fifo->curSize == 0);
+    return (fifo->curSize == fifo->size);
 }
 
 
@@ -160,9 +236,26 @@ dg_rcv_buf *CreateDgRcvBuf(int wndSize)
     dg_rcv_buf *buf = malloc(sizeof(dg_rcv_buf));
     buf->frameSize = 2 * wndSize;
     buf->firstSeq = 0;
-    int size = buf->frameSize * sizeof(struct filedatagram);
-    buf->buffer = malloc(size);
-    memset(buf->buffer, 0, size);
+    buf->nextSeq = 0;
+    buf->ts = 0;
+    buf->acked = 0;
+
+    // the frames are shared by the receive buffer and the fifo, plus the
+    // frames being received and the one being printed
+    buf->frameCount = buf->frameSize + FIFO_SIZE + DGBUF_MAXBATCH + 1;
+    int size = buf->frameCount * sizeof(struct filedatagram);
+    if (posix_memalign((void **)&buf->frames, DGBUF_ALIGN, size) != 0)
+    {
+        free(buf);
+        return NULL;
+    }
+    buf->freeFrames = malloc(buf->frameCount * sizeof(struct filedatagram *));
+    for (buf->freeCount = 0; buf->freeCount < buf->frameCount; buf->freeCount++)
+        buf->freeFrames[buf->freeCount] = &buf->frames[buf->frameCount - 1 - buf->freeCount];
+
+    // the slots are never cleared, a slot is in use only if its bit is set
+    buf->buffer = malloc(buf->frameSize * sizeof(struct filedatagram *));
+    buf->bitmap = calloc((buf->frameSize + 63) / 64, sizeof(uint64_t));
 
     // initial sliding window index
     buf->rwnd.base = 0;
@@ -173,6 +266,7 @@ dg_rcv_buf *CreateDgRcvBuf(int wndSize)
 
     // initial mutex
     Pthread_mutex_init(&buf->mutex, NULL);
+    Pthread_mutex_init(&buf->poolMutex, NULL);
 
     return buf;
 }
@@ -184,6 +278,19 @@ void DestroyDgRcvBuf(dg_rcv_buf *buf)
 
     // destroy mutex
     pthread_mutex_destroy(&buf->mutex);
+    pthread_mutex_destroy(&buf->poolMutex);
+
+    if (buf->frames)
+    {
+        free(buf->frames);
+        buf->frames = NULL;
+    }
+
+    if (buf->freeFrames)
+    {
+        free(buf->freeFrames);
+        buf->freeFrames = NULL;
+    }
 
     if (buf->buffer)
     {
@@ -191,29 +298,105 @@ void DestroyDgRcvBuf(dg_rcv_buf *buf)
         buf->buffer = NULL;
     }
 
+    if (buf->bitmap)
+    {
+        free(buf->bitmap);
+        buf->bitmap = NULL;
+    }
+
     // free dg_rcv_buf object
     free(buf);
     buf = NULL;
 }
 
-// check current seq number in sliding window
-int CheckSeqRange(dg_rcv_buf *buf, uint32_t idx)
+// take a frame from the frame pool
+static struct filedatagram *AllocDgRcvFrame(dg_rcv_buf *buf)
 {
-    int top = buf->rwnd.top;
-    int next = buf->rwnd.next;
+    struct filedatagram *frame = NULL;
 
-    if (top > next)
-    {
-        if (idx > top ||  // out of window size
-            idx < next)    // less than expect segment seq
-            return -1;
-    }
-    else
+    DgLock(&buf->poolMutex);
+    if (buf->freeCount > 0)
+        frame = buf->freeFrames[--buf->freeCount];
+    DgUnlock(&buf->poolMutex);
+
+    return frame;
+}
+
+// check the frame is from the frame pool
+static inline int IsDgRcvFrame(dg_rcv_buf *buf, const struct filedatagram *frame)
+{
+    return frame >= buf->frames && frame < buf->frames + buf->frameCount;
+}
+
+void FreeDgRcvFrame(dg_rcv_buf *buf, struct filedatagram *frame)
+{
+    if (frame == NULL)
+        return;
+
+    // also called by the print thread
+    DgLock(&buf->poolMutex);
+    buf->freeFrames[buf->freeCount++] = frame;
+    DgUnlock(&buf->poolMutex);
+}
+
+struct filedatagram *GetDgRcvFrame(dg_rcv_buf *buf)
+{
+    return AllocDgRcvFrame(buf);
+}
+
+// test, set and clear the occupancy bit of a frame
+static inline int TestFrame(dg_rcv_buf *buf, uint32_t idx)
+{
+    return (buf->bitmap[idx >> 6] >> (idx & 63)) & 1;
+}
+
+static inline void SetFrame(dg_rcv_buf *buf, uint32_t idx)
+{
+    buf->bitmap[idx >> 6] |= (uint64_t)1 << (idx & 63);
+}
+
+static inline void ClearFrame(dg_rcv_buf *buf, uint32_t idx)
+{
+    buf->bitmap[idx >> 6] &= ~((uint64_t)1 << (idx & 63));
+}
+
+// count the occupied frames in a row starting from idx (wrap around),
+// scanning one 64-bit word at a time
+static uint32_t CountFrameRun(dg_rcv_buf *buf, uint32_t idx)
+{
+    uint32_t run = 0, avail, n;
+    uint64_t holes;
+
+    while (run < buf->frameSize)
     {
-        if (idx < next)
-            return -1;
+        // the frames of this word that are still inside the buffer
+        avail = min(64 - (idx & 63), buf->frameSize - idx);
+
+        // the first zero bit from idx is the first hole
+        holes = ~(buf->bitmap[idx >> 6] >> (idx & 63));
+        n = holes ? __builtin_ctzll(holes) : 64;
+        if (n < avail)
+            return run + n;
+
+        run += avail;
+        idx = (idx + avail) % buf->frameSize;
     }
 
+    return buf->frameSize;
+}
+
+// check current seq number in sliding window
+// the window covers [seq of base, seq of base + size), compare by seq so
+// the check still holds when the window indexes wrap around
+int CheckSeqRange(dg_rcv_buf *buf, uint32_t seq)
+{
+    uint32_t inOrderPkt = (buf->rwnd.next + buf->frameSize - buf->rwnd.base) % buf->frameSize;
+    uint32_t baseSeq = buf->nextSeq - inOrderPkt;
+
+    if (seq < buf->nextSeq ||               // less than expect segment seq
+        seq >= baseSeq + buf->rwnd.size)    // out of window size
+        return -1;
+
     return 0;
 }
 
@@ -230,7 +413,7 @@ int WriteDgRcvBuf(dg_rcv_buf *buf, const struct filedatagram *data, int print, u
     int ret = 0;
     uint32_t idx = data->seq % buf->frameSize;
 
-    if (buf->firstSeq > 0 && buf->buffer[idx].seq == data->seq)
+    if (buf->firstSeq > 0 && TestFrame(buf, idx) && buf->buffer[idx]->seq == data->seq)
     {
         if (print)
             printf("[Client]: Receive datagram #%d, is already in buffer\n", data->seq);
@@ -238,7 +421,17 @@ int WriteDgRcvBuf(dg_rcv_buf *buf, const struct filedatagram *data, int print, u
     }
 
     // lock
-    DgLock(buf->mutex);
+    DgLock(&buf->mutex);
+
+    // a pool frame already holds the datagram and becomes the slot, any
+    // other datagram is copied to a new frame
+    int pooled = IsDgRcvFrame(buf, data);
+    struct filedatagram *frame = (struct filedatagram *)data;
+    if (!pooled && (frame = AllocDgRcvFrame(buf)) == NULL)
+    {
+        DgUnlock(&buf->mutex);
+        return DGBUF_RWND_FULL;
+    }
 
     dg_sliding_wnd *rwnd = &buf->rwnd;
     if (buf->firstSeq == 0)
@@ -253,26 +446,27 @@ int WriteDgRcvBuf(dg_rcv_buf *buf, const struct filedatagram *data, int print, u
     }
     else
     {
-        if (CheckSeqRange(buf, idx) < 0)
+        if (CheckSeqRange(buf, data->seq) < 0)
         {
             if (print)
                 printf("[Client]: Receive datagram #%d, idx = %d, is out of range, rwin [%d, %d] next = %d win = %d\n",
                     data->seq, idx, buf->rwnd.base, buf->rwnd.top, buf->rwnd.next, buf->rwnd.win);
-            DgUnlock(buf->mutex);
+            if (!pooled)
+                FreeDgRcvFrame(buf, frame);
+            DgUnlock(&buf->mutex);
             return DGBUF_SEGMENT_OUTOFRANGE;
         }
 
         if (idx == rwnd->next)
         {
-            do
-            {
-                // in-order
-                // expected seq number
-                buf->nextSeq++;
-                buf->ts = data->ts;   // store current timestamp
-                rwnd->next = (buf->rwnd.next + 1) % buf->frameSize;
-
-            } while(buf->buffer[rwnd->next].seq != 0);  // check next frame
+            // in-order, this segment and the following buffered segments
+            // (if it fills a gap) become in-order at once
+            uint32_t run = 1 + CountFrameRun(buf, (idx + 1) % buf->frameSize);
+
+            // expected seq number
+            buf->nextSeq += run;
+            buf->ts = data->ts;   // store current timestamp
+            rwnd->next = (rwnd->next + run) % buf->frameSize;
         }
         else
         {
@@ -283,33 +477,32 @@ int WriteDgRcvBuf(dg_rcv_buf *buf, const struct filedatagram *data, int print, u
         }
     }
 
-    memcpy(&buf->buffer[idx], data, sizeof(struct filedatagram));
-    rwnd->win--;
+    // traced even if not printed
+    tr_event(TR_CLI_RECV, (data->flag.eof ? TR_F_EOF : 0) | (data->flag.pob ? TR_F_POB : 0),
+             data->seq, data->ts, rwnd->win - 1, 0);
 
-    if (print)
-    {
-        printf("[Client]: Receive datagram #%d (ts = %d, rwnd = %d)",
-            data->seq, data->ts, rwnd->win);
-        if (data->flag.eof == 1)
-            printf(" <EOF>");
-        if (data->flag.pob == 1)
-            printf(" <POB>");
-        printf("\n");
-    }
+    // a stored pool frame belongs to the buffer now, it is handed to the
+    // print thread once delivered, so the caller should not use it after
+    if (!pooled)
+        memcpy(frame, data, DATAGRAM_HEADERSIZE + min(data->len, DATAGRAM_DATASIZE));
+
+    buf->buffer[idx] = frame;
+    SetFrame(buf, idx);
+    rwnd->win--;
 
     // unlock
-    DgUnlock(buf->mutex);
+    DgUnlock(&buf->mutex);
 
     return ret;
 }
 
-int ReadDgRcvBuf(dg_rcv_buf *buf, struct filedatagram *data, int need)
+int ReadDgRcvBuf(dg_rcv_buf *buf, struct filedatagram **data, int need)
 {
     int flag = 0;
     int inOrderPkt = 0;
 
     // lock
-    DgLock(buf->mutex);
+    DgLock(&buf->mutex);
 
     if (buf->rwnd.next < buf->rwnd.base)
         inOrderPkt = (buf->rwnd.next + buf->frameSize) - buf->rwnd.base;
@@ -327,7 +520,7 @@ int ReadDgRcvBuf(dg_rcv_buf *buf, struct filedatagram *data, int need)
         if (inOrderPkt < buffered)
         {
             // there are segment gaps, waiting to some segments fill the gaps
-            DgUnlock(buf->mutex);
+            DgUnlock(&buf->mutex);
             return -1;
         }
         else
@@ -339,9 +532,10 @@ int ReadDgRcvBuf(dg_rcv_buf *buf, struct filedatagram *data, int need)
 
     if (flag)
     {
+        // hand the frame out, the slot gets a new frame when it is written
         int idx = buf->rwnd.base;
-        memcpy(data, &buf->buffer[idx], sizeof(struct filedatagram));
-        memset(&buf->buffer[idx], 0, sizeof(struct filedatagram));
+        *data = buf->buffer[idx];
+        ClearFrame(buf, idx);
 
         // slide window to right
         buf->rwnd.base = (buf->rwnd.base + 1) % buf->frameSize;
@@ -349,16 +543,16 @@ int ReadDgRcvBuf(dg_rcv_buf *buf, struct filedatagram *data, int need)
         buf->rwnd.win++;
 
 #ifdef DEBUG_BUFFER
-        printf("[RcvBuf]: Read buffer, seq = %d ts = %d win = %d\n", data->seq, data->ts, buf->rwnd.win);
+        printf("[RcvBuf]: Read buffer, seq = %d ts = %d win = %d\n", (*data)->seq, (*data)->ts, buf->rwnd.win);
 #endif
 
         // unlock
-        DgUnlock(buf->mutex);
+        DgUnlock(&buf->mutex);
         return --inOrderPkt;
     }
 
     // unlock
-    DgUnlock(buf->mutex);
+    DgUnlock(&buf->mutex);
 
     return -1;
 }
@@ -369,7 +563,7 @@ int GetInOrderAck(dg_rcv_buf *buf, uint32_t *ack, uint32_t *ts)
     int inOrderPkt = 0;
 
     // lock
-    DgLock(buf->mutex);
+    DgLock(&buf->mutex);
 
     if (buf->rwnd.next < buf->rwnd.base)
         inOrderPkt = (buf->rwnd.next + buf->frameSize) - buf->rwnd.base;
@@ -380,28 +574,25 @@ int GetInOrderAck(dg_rcv_buf *buf, uint32_t *ack, uint32_t *ts)
     *ts = 0;
     if (inOrderPkt > 1)
     {
-        // get last received segment
-        int idx = buf->rwnd.next - 1;
-        if (buf->rwnd.next == 0)
-            idx = buf->frameSize - 1;
-
+        // last received segment is nextSeq - 1, its frame may have been
+        // handed out already, nextSeq and ts are kept in the buffer
         // last received segment seq - acked seq >= 2,
         // then send a ack to server
-        if (buf->buffer[idx].seq - buf->acked < 1)
+        if (buf->nextSeq - 1 - buf->acked < 1)
         {
-            DgUnlock(buf->mutex);
+            DgUnlock(&buf->mutex);
             return -1;
         }
 
-        *ack = buf->buffer[idx].seq+1;
-        *ts = buf->buffer[idx].ts;
+        *ack = buf->nextSeq;
+        *ts = buf->ts;
 
-        DgUnlock(buf->mutex);
+        DgUnlock(&buf->mutex);
         return 0;
     }
 
     // unlock
-    DgUnlock(buf->mutex);
+    DgUnlock(&buf->mutex);
 
     return -1;
 }
@@ -18,6 +18,10 @@
 
 #define FIFO_SIZE   512
 
+#define DGFIFO_COPY_NONE    0   // data is owned by the caller
+#define DGFIFO_COPY_HEAP    1   // data is malloc'ed
+#define DGFIFO_COPY_SLAB    2   // data is from the fifo data slab
+
 /**
 * @brief Define node struct
 */
@@ -25,6 +29,7 @@ typedef struct dg_node_t
 {
     int        size;        // data size
     char      *data;        // data
+    int        copied;      // data is a copy owned by the node, DGFIFO_COPY_*
     struct dg_node_t *next; // next node
 }dg_node;
 
@@ -37,6 +42,8 @@ typedef struct dg_fifo_t
     int      curSize;      // current fifo size
     dg_node *head;         // head node
     dg_node *curData;      // current node
+    struct dg_slab *nodes; // node allocator
+    struct dg_slab *datas; // allocator of copied data up to a datagram
     pthread_mutex_t	mutex; // mutex value
 }dg_fifo;
 
@@ -70,6 +77,23 @@ int WriteDgFifo(dg_fifo *fifo, const void *data, int dataSize);
 **/
 int ReadDgFifo(dg_fifo *fifo, void *data, int *dataSize);
 
+/**
+* @brief  Put a data pointer to fifo without copying the data
+* @param[in] fifo     : fifo object
+* @param[in] data     : data pointer, still owned by the caller
+* @param[in] dataSize : data size
+* @return  fifo current size if OK, -1 on error
+**/
+int PushDgFifo(dg_fifo *fifo, void *data, int dataSize);
+
+/**
+* @brief  Get a data pointer put by PushDgFifo from fifo
+* @param[in]  fifo     : fifo object
+* @param[out] dataSize : data size
+* @return  data pointer if OK, NULL if fifo is empty
+**/
+void *PopDgFifo(dg_fifo *fifo, int *dataSize);
+
 /**
 * @brief  Get fifo empty status
 * @param[in] fifo : fifo object
@@ -121,9 +145,18 @@ typedef struct dg_rcv_buf_t
     uint32_t        acked;          // last ack number
     pthread_mutex_t	mutex;          // mutex value
     dg_sliding_wnd  rwnd;           // receive sliding window
-    struct filedatagram *buffer;    // buffer array, the size is frameSize
+    uint64_t       *bitmap;         // occupancy bitmap, one bit per frame
+    struct filedatagram **buffer;   // frame pointer array, the size is frameSize
+    struct filedatagram *frames;    // frame pool, receive buffer + fifo + batch + 1
+    struct filedatagram **freeFrames; // free frame stack
+    uint32_t        frameCount;     // frame pool size
+    uint32_t        freeCount;      // free frame count
+    pthread_mutex_t poolMutex;      // frame pool mutex value
 }dg_rcv_buf;
 
+#define DGBUF_ALIGN     64          // frame pool alignment (cache line)
+#define DGBUF_MAXBATCH  64          // max # frames being received at once
+
 /**
 * @brief  Create receive buffer object
 * @param[in] wndSize  : sliding window size
@@ -137,8 +170,25 @@ dg_rcv_buf *CreateDgRcvBuf(int wndSize);
 **/
 void DestroyDgRcvBuf(dg_rcv_buf *buf);
 
+/**
+* @brief  Get a free frame to receive a datagram into
+* @param[in] buf : receive buffer object
+* @return  frame if OK, NULL if the frame pool is empty
+**/
+struct filedatagram *GetDgRcvFrame(dg_rcv_buf *buf);
+
+/**
+* @brief  Give a frame back to the frame pool
+* @param[in] buf   : receive buffer object
+* @param[in] frame : frame from GetDgRcvFrame or ReadDgRcvBuf
+**/
+void FreeDgRcvFrame(dg_rcv_buf *buf, struct filedatagram *frame);
+
 /**
 * @brief  Write data to receive buffer
+*         if data is a frame from GetDgRcvFrame, the frame itself is put in
+*         the buffer when 0 or DGBUF_SEGMENT_OUTOFORDER is returned and the
+*         caller should not use it any more; otherwise data is copied
 * @param[in] buf   : receive buffer object
 * @param[in] data  : struct filedatagram data
 * @param[in] print : print on screen flag
@@ -152,12 +202,13 @@ int WriteDgRcvBuf(dg_rcv_buf *buf, const struct filedatagram *data, int print, u
 
 /**
 * @brief  Read data from receive buffer object
-* @param[in] buf  : receive buffer object
-* @param[in] data : struct filedatagram data
-* @param[in] need : if 1 read current data
+*         the frame is handed out without copying, give it back by FreeDgRcvFrame
+* @param[in] buf   : receive buffer object
+* @param[out] data : frame of the in-order segment
+* @param[in] need  : if 1 read current data
 * @return if more than one segments data to read, return the segments number, -1 on error
 **/
-int ReadDgRcvBuf(dg_rcv_buf *buf, struct filedatagram *data, int need);
+int ReadDgRcvBuf(dg_rcv_buf *buf, struct filedatagram **data, int need);
 
 /**
 * @brief  Get in-order ack
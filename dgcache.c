@@ -0,0 +1,245 @@
+/*
+* @Author: Yinlong Su
+* @Date:   2015-10-28 10:12:45
+* @Last Modified by:   Yinlong Su
+* @Last Modified time: 2015-10-28 16:40:03
+*
+* File:         dgcache.c
+* Description:  Server File Cache C file
+*/
+
+#include <sys/mman.h>
+#include "udpfile.h"
+
+extern int tr_level;
+
+long    fc_memcap = FC_MEMCAP;  // memory cap of all cached files, in bytes
+long    fc_memory = 0;          // memory used by all cached files, in bytes
+uint32_t fc_hits = 0;           // cache hit counter
+uint32_t fc_misses = 0;         // cache miss counter
+
+struct file_cache *fc_table[FC_HASHSIZE];               // lookup by path
+struct file_cache *fc_lru_head = NULL, *fc_lru_tail = NULL; // LRU list
+
+/* --------------------------------------------------------------------------
+ *  fc_hash
+ *
+ *  File cache hash function
+ *
+ *  @param  : const char    *path
+ *  @return : uint32_t      # bucket index in fc_table
+ *
+ *  # This is a static inline function
+ * --------------------------------------------------------------------------
+ */
+static inline uint32_t fc_hash(const char *path) {
+    return Dg_hash(path) & (FC_HASHSIZE - 1);
+}
+
+/* --------------------------------------------------------------------------
+ *  fc_lru_unlink
+ *
+ *  Remove the entry from LRU list
+ *
+ *  @param  : struct file_cache *fc
+ *  @return : void
+ *
+ *  # This is a static inline function
+ * --------------------------------------------------------------------------
+ */
+static inline void fc_lru_unlink(struct file_cache *fc) {
+    if (fc->prev)
+        fc->prev->next = fc->next;
+    else
+        fc_lru_head = fc->next;
+    if (fc->next)
+        fc->next->prev = fc->prev;
+    else
+        fc_lru_tail = fc->prev;
+    fc->prev = fc->next = NULL;
+}
+
+/* --------------------------------------------------------------------------
+ *  fc_lru_push
+ *
+ *  Insert the entry at the head (most recently used) of LRU list
+ *
+ *  @param  : struct file_cache *fc
+ *  @return : void
+ *
+ *  # This is a static inline function
+ * --------------------------------------------------------------------------
+ */
+static inline void fc_lru_push(struct file_cache *fc) {
+    fc->prev = NULL;
+    fc->next = fc_lru_head;
+    if (fc_lru_head)
+        fc_lru_head->prev = fc;
+    fc_lru_head = fc;
+    if (fc_lru_tail == NULL)
+        fc_lru_tail = fc;
+}
+
+/* --------------------------------------------------------------------------
+ *  fc_detach
+ *
+ *  Remove the entry from the lookup table
+ *
+ *  @param  : struct file_cache *fc
+ *  @return : void
+ *
+ *  A detached entry can not be hit any more, it is destroyed when the last
+ *  session using it is released
+ * --------------------------------------------------------------------------
+ */
+static void fc_detach(struct file_cache *fc) {
+    struct file_cache **pp;
+
+    for (pp = &fc_table[fc_hash(fc->path)]; *pp != NULL; pp = &(*pp)->hnext)
+        if (*pp == fc) {
+            *pp = fc->hnext;
+            break;
+        }
+    fc->hnext = NULL;
+    fc->stale = 1;
+}
+
+/* --------------------------------------------------------------------------
+ *  fc_destroy
+ *
+ *  Unmap and free the entry
+ *
+ *  @param  : struct file_cache *fc
+ *  @return : void
+ * --------------------------------------------------------------------------
+ */
+static void fc_destroy(struct file_cache *fc) {
+    if (!fc->stale)
+        fc_detach(fc);
+    fc_lru_unlink(fc);
+    if (fc->addr)
+        munmap(fc->addr, fc->size);
+    fc_memory -= fc->size;
+    free(fc);
+}
+
+/* --------------------------------------------------------------------------
+ *  fc_evict
+ *
+ *  File cache eviction function
+ *
+ *  @param  : void
+ *  @return : void
+ *
+ *  Walk the LRU list from the tail and destroy the entries not used by any
+ *  session until the memory used is within fc_memcap
+ * --------------------------------------------------------------------------
+ */
+static void fc_evict() {
+    struct file_cache *fc, *prev;
+
+    for (fc = fc_lru_tail; fc != NULL && fc_memory > fc_memcap; fc = prev) {
+        prev = fc->prev;
+        if (fc->refcnt == 0) {
+            printf("[Server]: File cache evict \"%s\" (%ld bytes).\n", fc->path, (long)fc->size);
+            fc_destroy(fc);
+        }
+    }
+}
+
+/* --------------------------------------------------------------------------
+ *  fc_acquire
+ *
+ *  File cache acquire function
+ *
+ *  @param  : char  *path
+ *  @return : struct file_cache *   # NULL if the file can not be mapped
+ *
+ *  Look up the file by path, the entry is valid only if the inode, size
+ *  and mtime are the same as the file on disk. Otherwise the file is
+ *  mapped read-only and added to the cache.
+ *  The reference counter is increased, the caller should call fc_release
+ *  when the session is finished.
+ * --------------------------------------------------------------------------
+ */
+struct file_cache *fc_acquire(char *path) {
+    int     fd, hit = 0;
+    void    *addr = NULL;
+    struct stat st;
+    struct file_cache *fc;
+
+    if (stat(path, &st) < 0 || !S_ISREG(st.st_mode))
+        return NULL;
+
+    for (fc = fc_table[fc_hash(path)]; fc != NULL; fc = fc->hnext)
+        if (strcmp(fc->path, path) == 0)
+            break;
+
+    if (fc && fc->dev == st.st_dev && fc->ino == st.st_ino && fc->size == st.st_size && fc->mtime == st.st_mtime) {
+        fc_hits ++;
+        hit = 1;
+    } else {
+        // the file has been changed, the old entry can not be hit any more
+        if (fc) {
+            fc_detach(fc);
+            if (fc->refcnt == 0)
+                fc_destroy(fc);
+        }
+
+        fc_misses ++;
+        if ((fd = open(path, O_RDONLY)) < 0)
+            return NULL;
+        if (st.st_size > 0 && (addr = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0)) == MAP_FAILED) {
+            close(fd);
+            return NULL;
+        }
+        close(fd);
+
+        fc = Malloc(sizeof(struct file_cache));
+        bzero(fc, sizeof(*fc));
+        snprintf(fc->path, sizeof(fc->path), "%s", path);
+        fc->dev = st.st_dev;
+        fc->ino = st.st_ino;
+        fc->size = st.st_size;
+        fc->mtime = st.st_mtime;
+        fc->addr = addr;
+
+        fc->hnext = fc_table[fc_hash(path)];
+        fc_table[fc_hash(path)] = fc;
+        fc_lru_push(fc);
+        fc_memory += fc->size;
+    }
+
+    fc->refcnt ++;
+    fc_lru_unlink(fc);
+    fc_lru_push(fc);
+    fc_evict();
+
+    // once per request, only at the most verbose level
+    if (tr_level >= TR_DEBUG)
+        printf("[Server]: File cache %s \"%s\" (refcnt = %d, hits = %u, misses = %u, memory = %ld/%ld bytes).\n",
+            hit ? "hit" : "miss", path, fc->refcnt, fc_hits, fc_misses, fc_memory, fc_memcap);
+    return fc;
+}
+
+/* --------------------------------------------------------------------------
+ *  fc_release
+ *
+ *  File cache release function
+ *
+ *  @param  : struct file_cache *fc
+ *  @return : void
+ *
+ *  Decrease the reference counter. Stale entries are destroyed once no
+ *  session uses them, others stay in the cache until evicted.
+ * --------------------------------------------------------------------------
+ */
+void fc_release(struct file_cache *fc) {
+    if (fc == NULL)
+        return;
+
+    if (-- fc->refcnt == 0 && fc->stale)
+        fc_destroy(fc);
+    else
+        fc_evict();
+}
@@ -6,20 +6,25 @@
 * @changelog    :
 **/
 
+#define _GNU_SOURCE     // recvmmsg
+
 #include <math.h>
 #include <setjmp.h>
+#include <sys/timerfd.h>
 
 #include "dgcli_impl.h"
 
 #define RCV_TIMEOUT      5           // 5 seconds
-#define SIG_DELAYEDACK  (SIGRTMAX)
 #define RANDOM_MAX       0x7FFFFFFF  // 2^31 - 1
-#define FIN_TIMEWAIT     30          // 30 seconds
+#define FIN_RETRIES      3           // FIN resent at most 3 times, one rto apart
+#define MCAST_TIMEOUT    60          // 60 seconds
 
 sigjmp_buf g_jmpbuf;
 int        g_threadStop;
 
-void   GetDatagram(dg_client *cli, int need);
+int    DeliverDatagram(dg_client *cli);
+int    IsDgCe(struct msghdr *msg);
+int    GrowDgMcastSlots(struct filedatagram ***slots, uint32_t *nslots, uint32_t size);
 double DgRandom();
 void   SetRTTTimer(uint32_t timeout);
 
@@ -30,8 +35,23 @@ dg_client *CreateDgCli(const dg_arg *arg, int sock)
     cli->sock = sock;
     cli->timeout = RCV_TIMEOUT;
     cli->seq = 0;
+    cli->cid = 0;
+    cli->fileNext = 0;
+    cli->reqPending = 0;
+    cli->finPending = 0;
+    cli->finTries = 0;
     cli->printSeq = 1;
     cli->printFile = 1;
+    cli->ackTimer = -1;
+    cli->ackArmed = 0;
+    cli->ackEvery = DELAYED_ACK_SEGS;
+    cli->ackDelay = DELAYED_ACK_USEC;
+    cli->ackPending = 0;
+    cli->ackRcvd = 0;
+    cli->ceCount = 0;
+    cli->advWin = arg->rcvWin;
+    cli->rcvBatch = RCV_BATCH;
+    cli->gro = 1;
 
     // create a receive buffer, the buffer size is
     // twice the receive sliding window size
@@ -54,6 +74,10 @@ void DestroyDgCli(dg_client *cli)
     // destroy the fifo
     DestroyDgFifo(cli->fifo);
 
+    // close the delayed ack timer
+    if (cli->ackTimer >= 0)
+        close(cli->ackTimer);
+
     // free dg_client object resource
     free(cli);
     cli = NULL;
@@ -65,31 +89,13 @@ void HandleConnectTimeout(int signo)
     siglongjmp(g_jmpbuf, 1);
 }
 
-// handle fin time out
-void HandleFinTimeout(int signo)
-{
-    siglongjmp(g_jmpbuf, 1);
-}
-
 // handle receive data time out
 void HandleRecvTimeout(int signo)
 {
     // just interrupt the operation
 }
 
-// handle delayed ack time out
-void HandleDelayedAckTimeout(int signo, siginfo_t *siginfo, void *context)
-{
-    dg_client *cli;
-    cli = (dg_client *)siginfo->si_value.sival_ptr;
-    if (cli == NULL)
-        return;
-
-    int need = 1;
-    GetDatagram(cli, need);
-}
-
-// reconnect the server
+// connect the private port of server
 void ReconnectDgSrv(dg_client *cli)
 {
     struct sockaddr_in srvAddr;
@@ -102,17 +108,135 @@ void ReconnectDgSrv(dg_client *cli)
 
     Connect(cli->sock, (SA *)&srvAddr, sizeof(srvAddr));
 
-    printf("[Client]: Reconnect server %s:%d\n", cli->arg->srvIP, cli->newPort);
+    printf("[Client]: Connect server private port %s:%d\n", cli->arg->srvIP, cli->newPort);
+}
+
+// return 1 if the IP_TOS control message of msg carries the CE codepoint
+int IsDgCe(struct msghdr *msg)
+{
+    struct cmsghdr *cmsg;
+
+    for (cmsg = CMSG_FIRSTHDR(msg); cmsg != NULL; cmsg = CMSG_NXTHDR(msg, cmsg))
+    {
+        if (cmsg->cmsg_level == IPPROTO_IP && cmsg->cmsg_type == IP_TOS)
+            return (*(unsigned char *)CMSG_DATA(cmsg) & IPTOS_ECN_MASK) == IPTOS_ECN_CE;
+    }
+
+    return 0;
+}
+
+// receive up to n datagrams with one recvmmsg call, one iovec each
+// len[i] is set to the size of datagram i, ce[i] to 1 if it is CE marked
+int RecvDgMmsg(dg_client *cli, struct iovec *iovs, int *len, char *ce, int n)
+{
+    struct mmsghdr msgs[DGBUF_MAXBATCH];
+    char ctrl[DGBUF_MAXBATCH][CMSG_SPACE(sizeof(int))];
+    int i, ret;
+
+    bzero(msgs, n * sizeof(msgs[0]));
+    for (i = 0; i < n; i++)
+    {
+        msgs[i].msg_hdr.msg_iov = &iovs[i];
+        msgs[i].msg_hdr.msg_iovlen = 1;
+        msgs[i].msg_hdr.msg_control = ctrl[i];
+        msgs[i].msg_hdr.msg_controllen = sizeof(ctrl[i]);
+    }
+
+    // the socket is readable, take whatever else is queued without blocking
+    ret = recvmmsg(cli->sock, msgs, n, MSG_DONTWAIT, NULL);
+    for (i = 0; i < ret; i++)
+    {
+        len[i] = msgs[i].msg_len;
+        ce[i] = IsDgCe(&msgs[i].msg_hdr);
+    }
+
+    return ret;
+}
+
+// receive one coalesced buffer (UDP_GRO) with one recvmsg call, scattered
+// over the iovecs; every segment but the last is DATAGRAM_PAYLOAD bytes,
+// so segment i lands exactly in iovec i
+// len[i] is set to the size of datagram i, ce[i] to 1 if it is CE marked
+// (the kernel only coalesces datagrams of the same TOS)
+int RecvDgGro(dg_client *cli, struct iovec *iovs, int *len, char *ce, int n)
+{
+    char ctrl[2 * CMSG_SPACE(sizeof(int))];
+    struct msghdr msg;
+    struct cmsghdr *cmsg;
+    int i, ret, gso = 0, segs = 1;
+
+    bzero(&msg, sizeof(msg));
+    msg.msg_iov = iovs;
+    msg.msg_iovlen = n;
+    msg.msg_control = ctrl;
+    msg.msg_controllen = sizeof(ctrl);
+
+    ret = recvmsg(cli->sock, &msg, MSG_DONTWAIT);
+    if (ret < 0)
+        return ret;
+
+    // segment size of a coalesced buffer
+    for (cmsg = CMSG_FIRSTHDR(&msg); cmsg != NULL; cmsg = CMSG_NXTHDR(&msg, cmsg))
+    {
+        if (cmsg->cmsg_level == SOL_UDP && cmsg->cmsg_type == UDP_GRO)
+            gso = *(int *)CMSG_DATA(cmsg);
+    }
+
+    if (gso == DATAGRAM_PAYLOAD)
+        segs = (ret + gso - 1) / gso;
+    else if (gso > 0 && gso < ret)
+    {
+        // segments of another size do not line up with the frames, keep
+        // the first one, the others are resent as if lost
+        printf("[Client]: Can not split %d bytes of %d-byte segments\n", ret, gso);
+        ret = gso;
+    }
+
+    for (i = 0; i < segs; i++)
+    {
+        len[i] = min(ret - i * DATAGRAM_PAYLOAD, DATAGRAM_PAYLOAD);
+        ce[i] = IsDgCe(&msg);
+    }
+
+    return segs;
 }
 
-// receive data with timer
-int RecvDataTimeout(dg_client *cli, struct filedatagram *data, int *size)
+// receive a batch of datagrams, each straight into a frame of the
+// receive buffer; with UDP_GRO one coalesced buffer is split into the
+// frames, otherwise up to n datagrams are received by one recvmmsg call
+// frames[i] is reused if still set, drop[i] is 1 if the loss emulation
+// discarded datagram i
+// return the number of datagrams received, -1 on error
+int RecvDgBatch(dg_client *cli, struct filedatagram **frames, char *drop, int n)
 {
-    int	ret = 0;
+    struct iovec iovs[DGBUF_MAXBATCH];
+    int len[DGBUF_MAXBATCH];
+    char ce[DGBUF_MAXBATCH];
+    int i, ret = 0;
     int retry = 120;
 
+    // a coalesced buffer may hold up to GSO_MAXSEGS datagrams
+    if (cli->gro)
+        n = DGBUF_MAXBATCH;
+
+    for (i = 0; i < n; i++)
+    {
+        if (frames[i] == NULL && (frames[i] = GetDgRcvFrame(cli->buf)) == NULL)
+            break;
+        iovs[i].iov_base = frames[i];
+        iovs[i].iov_len = DATAGRAM_PAYLOAD;
+    }
+    if ((n = i) == 0)
+        return -1;
+
 read_data_again:
-    ret = Dg_readpacket(cli->sock, data);
+    if (cli->gro)
+        ret = RecvDgGro(cli, iovs, len, ce, n);
+    else
+        ret = RecvDgMmsg(cli, iovs, len, ce, n);
+    // after the fin, a refused datagram means the server has closed
+    if (ret == -1 && errno == ECONNREFUSED && cli->finPending)
+        return -1;
     if (ret == -1 && (errno == EINTR || errno == ECONNREFUSED))
     {
         usleep(500);  // sleep 500ms  
@@ -124,21 +248,62 @@ read_data_again:
         goto read_data_again;
     }
 
-    *size = ret;
+    for (i = 0; i < ret; i++)
+    {
+        Dg_checkpacket(frames[i], len[i]);
 
-    if (cli->arg->p > 0 && DgRandom() <= cli->arg->p) {
-        // discard the datagram
-        printf("[Client]: Receive datagram #%d <DROPPED>\n", data->seq);
-        goto read_data_again;
+        drop[i] = (cli->arg->p > 0 && DgRandom() <= cli->arg->p);
+        st_xfer.dg_rcvd++;
+        if (drop[i])
+        {
+            st_xfer.dg_dropped++;
+            printf("[Client]: Receive datagram #%d <DROPPED>\n", frames[i]->seq);
+        }
+        else if (ce[i])
+        {
+            cli->ceCount++;
+            st_xfer.dg_ce++;
+        }
     }
 
     return ret;
 }
 
+// report the TOS byte of every datagram received, the server is told how
+// many of them a router marked CE (congestion experienced)
+void EnableDgEcn(dg_client *cli)
+{
+    const int on = 1;
+
+    if (setsockopt(cli->sock, IPPROTO_IP, IP_RECVTOS, &on, sizeof(on)) < 0)
+        printf("[Client]: IP_RECVTOS is not supported, CE marks are not reported\n");
+}
+
+// enable UDP_GRO on the socket, fall back to one datagram per receive if
+// the kernel does not support it
+void EnableDgGro(dg_client *cli)
+{
+    const int on = 1;
+
+    if (!cli->gro)
+        return;
+
+    if (setsockopt(cli->sock, SOL_UDP, UDP_GRO, &on, sizeof(on)) < 0)
+    {
+        printf("[Client]: UDP_GRO is not supported, receive datagrams one by one\n");
+        cli->gro = 0;
+    }
+}
+
 // send a filename request to server
-int SendDgSrvFilenameReq(dg_client *cli)
+// the server answers with the file at once, its data datagrams carry the
+// private port number (in ack) until the first ACK, first is set to the
+// first one received
+int SendDgSrvFilenameReq(dg_client *cli, struct filedatagram *first)
 {
-    struct filedatagram sndData, rcvData;
+    struct filedatagram sndData;
+    struct sockaddr_in srvAddr, from;
+    socklen_t len;
     // init filedatagram
     bzero(&sndData, sizeof(sndData));
     sndData.seq = cli->seq;
@@ -148,6 +313,13 @@ int SendDgSrvFilenameReq(dg_client *cli)
     sndData.len = strlen(cli->arg->filename);
     strcpy(sndData.data, cli->arg->filename);
 
+    // the socket is connected only when the private port is known, the
+    // request goes to the well-known port
+    bzero(&srvAddr, sizeof(srvAddr));
+    srvAddr.sin_family = AF_INET;
+    srvAddr.sin_port = htons(cli->arg->srvPort);
+    Inet_pton(AF_INET, cli->arg->srvIP, &srvAddr.sin_addr);
+
     // calc timeout value & start timer
     SetRTTTimer(rtt_start(&cli->rtt));
 
@@ -162,94 +334,56 @@ int SendDgSrvFilenameReq(dg_client *cli)
         SetRTTTimer(rtt_start(&cli->rtt));
     }
 
-    printf("[Client]: Send filename to server %s:%d", cli->arg->srvIP, cli->arg->srvPort, cli->rtt.rtt_nrexmt);
+    printf("[Client]: Send filename to server %s:%d", cli->arg->srvIP, cli->arg->srvPort);
     if (cli->rtt.rtt_nrexmt > 0)
         printf(" (Timeout #%2d)", cli->rtt.rtt_nrexmt);
     // if random() <= p, discard the datagram (just don't send)
     if (DgRandom() > cli->arg->p)
-        Dg_writepacket(cli->sock, &sndData);
+        Dg_sendpacket(cli->sock, (SA *)&srvAddr, sizeof(srvAddr), &sndData);
     else
         printf(" <DROPPED>");
     printf("\n");
 
-read_port_reply_again:
+read_first_again:
 
-    bzero(&rcvData, sizeof(rcvData));
-    Dg_readpacket(cli->sock, &rcvData);
+    len = sizeof(from);
+    Dg_recvpacket(cli->sock, (SA *)&from, &len, first);
     if (cli->arg->p > 0 && DgRandom() <= cli->arg->p)
     {
         // discard the datagram
-        if (rcvData.flag.pot == 1)
-            printf("[Client]: Received a valid private port number %s from server. <DROPPED>\n", rcvData.data);
-        goto read_port_reply_again;
+        st_xfer.dg_rcvd++;
+        st_xfer.dg_dropped++;
+        printf("[Client]: Receive datagram #%d with port number %d. <DROPPED>\n", first->seq, first->ack);
+        goto read_first_again;
     }
 
-
-    // stop rtt timer
-    SetRTTTimer(0);
-    // calculate & store new RTT estimator values
-    rtt_stop(&cli->rtt, rtt_ts(&cli->rtt) - rcvData.ts);
-
-    if (rcvData.flag.pot != 1)
+    // the socket is not connected, ignore anything but the server
+    if (from.sin_addr.s_addr != srvAddr.sin_addr.s_addr || first->flag.pot != 1 || first->seq == 0)
     {
         printf("[Client]: Received an invalid packet (no port number).\n");
-        return -1;
+        goto read_first_again;
     }
-    else
-    {
-        cli->newPort = atoi(rcvData.data);
-        printf("[Client]: Received a valid private port number %d from server.\n", cli->newPort);
-    }
-
-    return 0;
-}
-
-// send new port ack
-int SendDgSrvNewPortAck(dg_client *cli, struct filedatagram *data)
-{
-    struct filedatagram sndData;
-    // init filedatagram
-    bzero(&sndData, sizeof(sndData));
-
-    sndData.seq = cli->seq++;
-    sndData.ack = 1;
-    sndData.wnd = cli->buf->rwnd.size;
-    sndData.flag.pot = 1;
-    sndData.len = 0;
-
-    bzero(data, sizeof(*data));
-    while (1)
-    {
-        printf("[Client]: Send port ACK to server via new port");
-        // if random() <= p, discard the datagram (just don't send)
-        if (DgRandom() > cli->arg->p)
-            Dg_writepacket(cli->sock, &sndData);
-        else
-            printf(" <DROPPED>");
-        printf("\n");
 
-    read_port_again:
-        Dg_readpacket(cli->sock, data);
-        if (cli->arg->p > 0 && DgRandom() <= cli->arg->p)
-        {
-            // discard the datagram
-            printf("[Client]: Receive datagram #%d with ", data->seq);
-            if (data->flag.pot == 1)
-                printf("port number %s. <DROPPED>\n", data->data);
-            else
-                printf("file content. <DROPPED>\n");
-            goto read_port_again;
-        }
+    // stop rtt timer
+    SetRTTTimer(0);
+    st_xfer.dg_rcvd++;
+    cli->ackRcvd = rtt_ts(&cli->rtt);
+    // calculate & store new RTT estimator values, not for a resent request
+    if (cli->rtt.rtt_nrexmt == 0)
+        rtt_stop(&cli->rtt, rtt_ts(&cli->rtt) - sndData.ts);
 
-        if (data->seq > 0)
-            break;
-    }
+    cli->newPort = first->ack;
+    cli->cid = first->cid;
+    printf("[Client]: Received datagram #%d with a valid private port number %d from server (cid = %08x).\n", first->seq, cli->newPort, cli->cid);
 
     return 0;
 }
 
 // send ack to server
-void SendDgSrvAck(dg_client *cli, uint32_t ack, uint32_t ts, int wnd, int wndFlag, const char *tag)
+// tag is the reason of the ack, TR_TAG_*
+// ts is echoed with the time it was held since rcvd (rtt_ts of the client
+// when its segment arrived), rcvd = 0 if ts is not a rtt sample
+void SendDgSrvAck(dg_client *cli, uint32_t ack, uint32_t ts, uint32_t rcvd, int wnd, int wndFlag, int tag)
 {
     struct filedatagram dg;
     // init filedatagram
@@ -258,53 +392,103 @@ void SendDgSrvAck(dg_client *cli, uint32_t ack, uint32_t ts, int wnd, int wndFla
     dg.seq = cli->seq++;
     dg.ack = ack;
     dg.ts = ts;
+    dg.dly = rcvd ? min(rtt_ts(&cli->rtt) - rcvd, DATAGRAM_NOSAMPLE - 1) : DATAGRAM_NOSAMPLE;
+    dg.cid = cli->cid;
+    dg.ce = cli->ceCount;
     dg.flag.wnd = wndFlag;
     dg.wnd = wnd;
     dg.len = 0;
     cli->buf->acked = ack;
+    cli->advWin = wnd;
 
-    if (cli->printSeq) {
-        printf("[Client]: Send ACK #%d (ack = %d, ts = %d, wnd = %d)",
-            dg.ack, dg.ack, dg.ts, dg.wnd, tag);
-        if (dg.flag.wnd == 1)
-            printf(" <WND>");
-        printf(" (%s)", tag);
+    int flags = dg.flag.wnd ? TR_F_WND : 0;
+    if (DgRandom() > cli->arg->p)
+        Dg_writepacket(cli->sock, &dg);
+    else
+    {
+        flags |= TR_F_DROP;
+        st_xfer.acks_dropped++;
+    }
+    st_xfer.acks_sent++;
+    tr_event(TR_CLI_ACK, flags, dg.ack, dg.ts, dg.wnd, tag);
+}
+
+// request the next file of the session on the connected socket, the
+// request acks the whole last file (ack = first seq of the next file)
+// it is resent by the main loop until a datagram of the next file arrives
+void SendDgSrvNextReq(dg_client *cli)
+{
+    struct filedatagram dg;
+    const char *filename = cli->arg->files[cli->fileNext];
+
+    if (!cli->reqPending)
+    {
+        rtt_newpack(&cli->rtt);
+        cli->reqPending = 1;
+        cli->reqSeq = cli->buf->nextSeq;
+        cli->reqTs = rtt_ts(&cli->rtt);
     }
+
+    // init filedatagram
+    bzero(&dg, sizeof(dg));
+    dg.seq = cli->seq++;
+    dg.ack = cli->reqSeq;
+    dg.ts = cli->reqTs;
+    dg.cid = cli->cid;
+    dg.ce = cli->ceCount;
+    dg.wnd = cli->buf->rwnd.win;
+    dg.flag.fln = 1;
+    dg.len = min(strlen(filename), FILENAME_BUFFSIZE - 1);
+    memcpy(dg.data, filename, dg.len);
+    cli->buf->acked = dg.ack;
+    cli->advWin = dg.wnd;
+
+    printf("[Client]: Request next file \"%s\"", filename);
+    if (cli->rtt.rtt_nrexmt > 0)
+        printf(" (Timeout #%2d)", cli->rtt.rtt_nrexmt);
     if (DgRandom() > cli->arg->p)
         Dg_writepacket(cli->sock, &dg);
-    else if (cli->printSeq)
+    else
         printf(" <DROPPED>");
-    if (cli->printSeq)
-        printf("\n");
+    printf("\n");
 }
 
-// handle client to finish work
-void HandleDgClientFin(dg_client *cli)
+// close the session: the fin acks the whole last file, the server answers
+// with a fin-ack once it has seen it, so the client does not linger
+// it is resent by the main loop every rto, at most FIN_RETRIES times
+void SendDgSrvFin(dg_client *cli)
 {
-    Signal(SIGALRM, HandleFinTimeout);
+    struct filedatagram dg;
+    // init filedatagram
+    bzero(&dg, sizeof(dg));
 
-    // start fin timer
-    alarm(FIN_TIMEWAIT);
+    dg.seq = cli->seq++;
+    dg.ack = cli->buf->nextSeq;
+    dg.cid = cli->cid;
+    dg.ce = cli->ceCount;
+    dg.wnd = cli->buf->rwnd.win;
+    dg.flag.fin = 1;
+    cli->finPending = 1;
+
+    printf("[Client]: Send FIN to server");
+    if (cli->finTries > 0)
+        printf(" (Timeout #%2d)", cli->finTries);
+    if (DgRandom() > cli->arg->p)
+        Dg_writepacket(cli->sock, &dg);
+    else
+        printf(" <DROPPED>");
+    printf("\n");
+}
 
-    dg_client *dc = cli;
-    if (sigsetjmp(g_jmpbuf, 1) != 0)
-    {
-        if (g_threadStop == 1)
-        {
-            // timeout, retransmitting
-            printf("[Client]: Application exited\n");
-            alarm(0);
-            exit(0);
-        }
-        else
-        {
-            // reset
-            HandleDgClientFin(dc);
-        }
-    }
+// wait for the print thread and release the session
+void CloseDgClient(dg_client *cli, struct filedatagram **frames)
+{
+    int i;
 
-    if (cli->printSeq)
-        printf("[Client]: Wait timer(%ds) to clean close\n", FIN_TIMEWAIT);
+    for (i = 0; i < DGBUF_MAXBATCH; i++)
+        FreeDgRcvFrame(cli->buf, frames[i]);
+    pthread_join(cli->printTid, NULL);
+    printf("[Client]: Application exited\n");
 }
 
 //  print file content thread
@@ -319,18 +503,19 @@ void *PrintOutThread(void *arg)
     dg_client *cli = (dg_client *)arg;
 
     int size = 0;
-    int ret = 0;
+    int eof = 0;
+    int eofs = 0;
     int d = 0;
-    struct filedatagram fd;
+    struct filedatagram *fd;
 
     g_threadStop = 0;
     printf("[Client]: Print thread #%d is working\n", pthread_self());
 
     while (1)
     {
-        // get data from fifo
-        ret = ReadDgFifo(cli->fifo, &fd, &size);
-        if (ret < 0)
+        // get the frame from fifo, it is printed in place
+        fd = PopDgFifo(cli->fifo, &size);
+        if (fd == NULL)
         {
             // produce a random double in the range (0.0, 1.0)
             d = -1 * cli->arg->u * log(DgRandom()) * 1000;
@@ -340,14 +525,25 @@ void *PrintOutThread(void *arg)
 
         //printf("[Thread #%d]: Read fifo, seq=%d ack=%d ts=%d wnd=%d flag.eof=%d len=%d" \
             "\n--------------------\n%s\n--------------------\n", \
-            pthread_self(), fd.seq, fd.ack, fd.ts, fd.wnd, fd.flag.eof, fd.len, fd.data);
+            pthread_self(), fd->seq, fd->ack, fd->ts, fd->wnd, fd->flag.eof, fd->len, fd->data);
 
         if (cli->printFile)
-            printf("%s", fd.data);
+            fwrite(fd->data, 1, fd->len, stdout);
 
-        if (fd.flag.eof == 1)
+        // give the frame back to the receive buffer
+        eof = fd->flag.eof;
+        FreeDgRcvFrame(cli->buf, fd);
+
+        if (eof == 1)
         {
             printf("[Client Print]: File data finished\n");
+
+            // the next files of the session follow in the same fifo
+            if (++eofs <= cli->arg->nfiles)
+                continue;
+            printf("[Client Print]: Fifo node slab: allocs=%lu frees=%lu peak=%u blocks=%u\n",
+                   cli->fifo->nodes->allocs, cli->fifo->nodes->frees,
+                   cli->fifo->nodes->peak, cli->fifo->nodes->nblocks);
             break;
         }
     }
@@ -359,10 +555,9 @@ void *PrintOutThread(void *arg)
 // create a thread
 void CreateThread(dg_client *cli)
 {
-    pthread_t tid;
-    Pthread_create(&tid, NULL, &PrintOutThread, cli);
+    Pthread_create(&cli->printTid, NULL, &PrintOutThread, cli);
 
-    printf("[Client]: Create thread ok, tid = %d\n", tid);
+    printf("[Client]: Create thread ok, tid = %d\n", cli->printTid);
 }
 
 // set rtt timer
@@ -377,56 +572,68 @@ void SetRTTTimer(uint32_t timeout)
     setitimer(ITIMER_REAL, &it, NULL);
 }
 
-// set delayed ack timer
-int SetDelayedAckTimer(dg_client *cli)
+// create the delayed ack timer
+int CreateDelayedAckTimer(dg_client *cli)
 {
-    struct sigaction act;
-
-    sigemptyset(&act.sa_mask);
-    act.sa_sigaction = HandleDelayedAckTimeout; // handle dealyed ack function
-    act.sa_flags = SA_SIGINFO;
-
-    // register the SIG_DELAYEDACK signal
-    if (sigaction(SIG_DELAYEDACK, &act, NULL) < 0)
+    cli->ackTimer = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK);
+    if (cli->ackTimer < 0)
     {
-        printf("[Client]: Sigaction error\n");
+        printf("[Client]: timerfd_create error\n");
         return -1;
     }
+    cli->ackArmed = 0;
 
-    struct sigevent evp;
-    evp.sigev_notify = SIGEV_SIGNAL;
-    evp.sigev_signo = SIG_DELAYEDACK;
-    evp.sigev_value.sival_ptr = cli;    // pass the client object
-
-    // create a timer
-    if (timer_create(CLOCK_REALTIME, &evp, &cli->delayedAckTimer) < 0)
-    {
-        printf("[Client]: timer_create error\n");
-        return -1;
-    }
+    return 0;
+}
 
-    // set 500ms delayed ack timer
-    int n = 500;
+// arm the delayed ack timer to fire after usec microseconds, 0 to disarm
+void SetDelayedAckTimer(dg_client *cli, int usec)
+{
     struct itimerspec it;
-    it.it_interval.tv_sec = 0;
-    it.it_interval.tv_nsec = n * 1000000;
-    it.it_value.tv_sec = 0;
-    it.it_value.tv_nsec = 500 * 1000000;
+    bzero(&it, sizeof(it));
+    it.it_value.tv_sec = usec / 1000000;
+    it.it_value.tv_nsec = (usec % 1000000) * 1000;
+
+    timerfd_settime(cli->ackTimer, 0, &it, NULL);
+    cli->ackArmed = (usec > 0);
+}
 
-    // set the timer
-    if (timer_settime(cli->delayedAckTimer, 0, &it, NULL))
+// send the cumulative ack for all in-order segments pending
+void FlushDelayedAck(dg_client *cli, int tag)
+{
+    if (cli->ackPending > 0)
     {
-        printf("[Client]: timer_settime error\n");
-        return -1;
+        SendDgSrvAck(cli, cli->buf->nextSeq, cli->buf->ts, cli->ackRcvd, cli->buf->rwnd.win, cli->advWin == 0, tag);
+        cli->ackPending = 0;
     }
+    if (cli->ackArmed)
+        SetDelayedAckTimer(cli, 0);
+}
 
-    return 0;
+// handle delayed ack time out
+// 1. deliver in-order segments to fifo
+// 2. send the pending ack, or a window update if rwnd was advertised as 0
+// 3. re-arm the timer if the fifo is full and in-order segments remain
+void HandleDelayedAckTimeout(dg_client *cli)
+{
+    uint64_t expired;
+    read(cli->ackTimer, &expired, sizeof(expired));
+    cli->ackArmed = 0;
+
+    DeliverDatagram(cli);
+
+    if (cli->ackPending > 0)
+        FlushDelayedAck(cli, TR_TAG_DELAYED);
+    else if (cli->advWin == 0 && cli->buf->rwnd.win > 0)
+        SendDgSrvAck(cli, cli->buf->nextSeq, cli->buf->ts, 0, cli->buf->rwnd.win, 1, TR_TAG_RWND);
+
+    if (cli->buf->rwnd.next != cli->buf->rwnd.base)
+        SetDelayedAckTimer(cli, cli->ackDelay);
 }
 
 // connect server with RTO
 int ConnectDgServer(dg_client *cli)
 {
-    int ret = 0;
     struct filedatagram dg;
 
     Signal(SIGALRM, HandleConnectTimeout);
@@ -435,24 +642,16 @@ int ConnectDgServer(dg_client *cli)
     rtt_init(&cli->rtt);
     rtt_newpack(&cli->rtt);
 
-    do
+    // request the file, the first data datagram has the private port
+    if (SendDgSrvFilenameReq(cli, &dg) < 0)
     {
-        // connect server
-        ret = SendDgSrvFilenameReq(cli);
-        if (ret < 0)
-        {
-
-            printf("[Client]: Connect server %s:%d error\n", cli->arg->srvIP, cli->arg->srvPort);
-            return -1;
-        }
-
-        // reconnect server with new port number
-        ReconnectDgSrv(cli);
-
-        // send port ack
-        ret = SendDgSrvNewPortAck(cli, &dg);
+        printf("[Client]: Connect server %s:%d error\n", cli->arg->srvIP, cli->arg->srvPort);
+        return -1;
+    }
 
-    } while (ret < 0);
+    // connect server with new port number, the ACK of the first datagram
+    // acknowledges the port
+    ReconnectDgSrv(cli);
 
     printf("[Client]: Connect server %s:%d ok\n", cli->arg->srvIP, cli->newPort);
 
@@ -463,38 +662,30 @@ int ConnectDgServer(dg_client *cli)
     return 0;
 }
 
-// get datagram from buffer
-// 1. check the receiver window
-// 2. if there is in-order segments, put those segments to fifo
-// 3. if there is more than 2 in-order segments, send ack to server
-void GetDatagram(dg_client *cli, int need)
+// move in-order segments from receive buffer to fifo
+// return the number of segments moved
+int DeliverDatagram(dg_client *cli)
 {
-    int ret = 0, old_win = cli->buf->rwnd.win;
-    struct filedatagram dg;
+    int ret = 0, n = 0;
+    struct filedatagram *dg;
 
-    do
+    while (!DgFifoFull(cli->fifo))
     {
-        // get data from receive buffer
-        ret = ReadDgRcvBuf(cli->buf, &dg, need);
-        if (ret != -1)
-        {
-            // put data to fifo
-            WriteDgFifo(cli->fifo, &dg, sizeof(dg));
+        // get the frame from receive buffer
+        ret = ReadDgRcvBuf(cli->buf, &dg, 1);
+        if (ret == -1)
+            break;
 
-            //printf("[Client #%d]: Write datagram to fifo, seq=%d ack=%d ts=%d len=%d\n", \
-                pthread_self(), dg.seq, dg.ack, dg.ts, dg.len);
-        }
-        need = ret;
-    } while (ret > 0);
+        // put the frame to fifo, the print thread frees it
+        st_xfer.bytes_rcvd += dg->len;
+        PushDgFifo(cli->fifo, dg, sizeof(*dg));
+        n++;
 
-    if (ret != -1)
-    {
-        // segments in-order, send ack to server
-        if (old_win == 0)
-            SendDgSrvAck(cli, dg.seq + 1, 0/*dg.ts*/, cli->buf->rwnd.win, 1, "in-order & update rwnd");
-        else
-            SendDgSrvAck(cli, dg.seq + 1, 0/*dg.ts*/, cli->buf->rwnd.win, 0, "in-order");
+        if (ret == 0)
+            break;
     }
+
+    return n;
 }
 
 double DgRandom()
@@ -521,83 +712,419 @@ int StartDgCli(dg_client *cli)
     // create print out thread
     CreateThread(cli);
 
-    // set and start delayed ack timer
-    if (SetDelayedAckTimer(cli))
+    // coalesced receive, only after the handshake which reads one
+    // datagram at a time
+    EnableDgGro(cli);
+    EnableDgEcn(cli);
+
+    // create delayed ack timer
+    if (CreateDelayedAckTimer(cli))
         return -1;
 
-    struct filedatagram dg = { 0 };
-    int sz = sizeof(dg);
+    // ack the first segment saved while connecting
+    cli->ackPending = cli->buf->nextSeq - cli->buf->firstSeq;
+    DeliverDatagram(cli);
+    FlushDelayedAck(cli, TR_TAG_INORDER);
+
+    // datagrams are received into frames of the receive buffer, a frame
+    // not stored in the buffer is reused by the next batch
+    struct filedatagram *frames[DGBUF_MAXBATCH] = { NULL }, *dg;
+    char drop[DGBUF_MAXBATCH];
+    uint32_t finSeq = 0;
+    int i, n;
+    fd_set fds;
+    struct timeval tv, *tvp;
 
     // main loop
     while (1)
     {
-        bzero(&dg, sizeof(dg));
-        // receive data
-        ret = RecvDataTimeout(cli, &dg, &sz);
+        FD_ZERO(&fds);
+        FD_SET(cli->sock, &fds);
+        FD_SET(cli->ackTimer, &fds);
+
+        // wait no longer than the rto for the answer of a next file request
+        // or of the fin
+        tvp = NULL;
+        if (cli->reqPending || cli->finPending)
+        {
+            uint32_t rto = rtt_start(&cli->rtt);
+            tv.tv_sec = rto / 1000;
+            tv.tv_usec = (rto % 1000) * 1000;
+            tvp = &tv;
+        }
+        ret = select(max(cli->sock, cli->ackTimer) + 1, &fds, NULL, NULL, tvp);
         if (ret < 0)
         {
+            if (errno == EINTR)
+                continue;
+            else
+                break;
+        }
+
+        // the fin timed out, resend it or close without the fin-ack
+        if (ret == 0 && cli->finPending)
+        {
+            if (++cli->finTries > FIN_RETRIES)
+            {
+                printf("[Client]: No FIN-ACK from server, close\n");
+                CloseDgClient(cli, frames);
+                return 0;
+            }
+            SendDgSrvFin(cli);
+            continue;
+        }
+
+        // the next file request timed out, resend it
+        if (ret == 0)
+        {
+            if (rtt_timeout(&cli->rtt) < 0)
+            {
+                errno = 0;
+                err_msg("[Client]: No response from server %s:%d, giving up", cli->arg->srvIP, cli->newPort);
+                return -1;
+            }
+            SendDgSrvNextReq(cli);
+            continue;
+        }
+
+        // delayed ack timer expired
+        if (FD_ISSET(cli->ackTimer, &fds))
+            HandleDelayedAckTimeout(cli);
+
+        if (!FD_ISSET(cli->sock, &fds))
+            continue;
+
+        // receive a batch of data
+        n = RecvDgBatch(cli, frames, drop, cli->rcvBatch);
+        if (n < 0)
+        {
+            // the session of the server is already gone
+            if (cli->finPending && errno == ECONNREFUSED)
+            {
+                printf("[Client]: Server closed the session\n");
+                CloseDgClient(cli, frames);
+                return 0;
+            }
             if (errno == ETIMEDOUT || errno == EAGAIN)
                 continue;
             else
                 break;
         }
 
-#if 0
-        dg.len = ntohs(dg.len);
-        dg.seq = ntohl(dg.seq);
-        dg.ack = ntohl(dg.ack);
-        dg.ts  = ntohl(dg.ts);
-        dg.wnd = ntohs(dg.wnd);
-#endif
+        // put the whole batch to receive buffer, the acks are coalesced
+        // into one sent after the batch
+        uint32_t ack = 0, nextSeq = cli->buf->nextSeq, ackTs = 0, ackRcvd = 0;
+        uint32_t now = rtt_ts(&cli->rtt);
+        int ackNow = 0, wndFlag = 0, gapFilled = 0, closed = 0;
+        int tag = TR_TAG_INORDER;
+        for (i = 0; i < n; i++)
+        {
+            if (drop[i])
+                continue;
+            dg = frames[i];
 
+            // the server has seen the fin
+            if (dg->flag.fin == 1)
+            {
+                closed = cli->finPending;
+                continue;
+            }
+
+            // a datagram of the next file answers its request
+            if (cli->reqPending && dg->flag.pob == 0 && dg->seq >= cli->reqSeq)
+            {
+                if (cli->rtt.rtt_nrexmt == 0)
+                    rtt_stop(&cli->rtt, rtt_ts(&cli->rtt) - cli->reqTs);
+                cli->reqPending = 0;
+                cli->fileNext++;
+            }
+
+            // received window probe, send current window size
+            if (dg->flag.pob == 1)
+            {
+                ackNow = 1;
+                wndFlag = 1;
+                ackTs = dg->ts;
+                ackRcvd = now;
+                tag = TR_TAG_PROBE;
+                continue;
+            }
+
+            // the frame is owned by the receive buffer once stored, keep
+            // what is needed after delivering it
+            uint32_t seq = dg->seq, ts = dg->ts, prevSeq = cli->buf->nextSeq;
+            int eof = dg->flag.eof;
+            ret = WriteDgRcvBuf(cli->buf, dg, cli->printSeq, &ack);
+            if (ret == 0 || ret == DGBUF_SEGMENT_OUTOFORDER)
+            {
+                frames[i] = NULL;
+                if (eof == 1)
+                    finSeq = seq;
+            }
+
+            switch (ret)
+            {
+            case DGBUF_RWND_FULL:   // sliding window size is zero
+                ackNow = 1;
+                wndFlag = 1;
+                ackTs = ts;
+                ackRcvd = now;
+                tag = TR_TAG_ZEROWND;
+                break;
 
-        //printf("dg.seq=%d ret=%d, rwnd.base=%d rwnd.next=%d rwnd.top=%d\n", \
-            dg.seq, ret, cli->buf->rwnd.base, cli->buf->rwnd.next, cli->buf->rwnd.top);
+            // a segment received before is answered with the timestamp of
+            // the last in-order one, so the server can tell its resend was
+            // spurious; that timestamp is not a rtt sample
+            case DGBUF_SEGMENT_IN_BUF:      // segment is already in receive buffer
+                st_xfer.dg_dup++;
+                ackNow = 1;
+                ackTs = seq < cli->buf->nextSeq ? cli->buf->ts : ts;
+                ackRcvd = seq < cli->buf->nextSeq ? 0 : now;
+                tag = TR_TAG_INBUF;
+                break;
 
-        // received window probe
-        if (dg.flag.pob == 1)
+            case DGBUF_SEGMENT_OUTOFRANGE:  // segment is out of range
+                st_xfer.dg_outrange++;
+                ackNow = 1;
+                ackTs = seq < cli->buf->nextSeq ? cli->buf->ts : ts;
+                ackRcvd = seq < cli->buf->nextSeq ? 0 : now;
+                tag = TR_TAG_OUTOFRANGE;
+                break;
+
+            case DGBUF_SEGMENT_OUTOFORDER:  // out of order, send duplicate ack immediately
+                st_xfer.dg_ooo++;
+                SendDgSrvAck(cli, ack, ts, now, cli->buf->rwnd.win, 0, TR_TAG_OUTOFORDER);
+                cli->ackPending = 0;
+                nextSeq = cli->buf->nextSeq;
+                break;
+
+            default:                        // in-order segment
+                if (cli->buf->nextSeq - prevSeq > 1)
+                    gapFilled = 1;
+                break;
+            }
+        }
+
+        // put in-order segments to fifo
+        if (cli->buf->nextSeq != nextSeq)
+            cli->ackRcvd = now;
+        cli->ackPending += cli->buf->nextSeq - nextSeq;
+        DeliverDatagram(cli);
+
+        int fin = (finSeq > 0 && finSeq + 1 == cli->buf->nextSeq);
+        if (ackNow)
         {
-            // send current window size
-            SendDgSrvAck(cli, cli->buf->nextSeq, dg.ts, cli->buf->rwnd.win, 1, "received window probe");
-            continue;
+            // one ack answers every segment of the batch that asked for it
+            if (cli->buf->nextSeq != nextSeq)
+            {
+                ackTs = cli->buf->ts;
+                ackRcvd = now;
+            }
+            SendDgSrvAck(cli, cli->buf->nextSeq, ackTs, ackRcvd, cli->buf->rwnd.win, wndFlag, tag);
+            cli->ackPending = 0;
+            if (cli->ackArmed)
+                SetDelayedAckTimer(cli, 0);
+        }
+        // ack every ackEvery segments, when a gap is filled, or at eof;
+        // otherwise hold the ack for at most ackDelay microseconds
+        else if (cli->ackPending >= cli->ackEvery || gapFilled || (fin && cli->ackPending > 0))
+            FlushDelayedAck(cli, TR_TAG_INORDER);
+        else if (cli->ackPending > 0 && !cli->ackArmed)
+            SetDelayedAckTimer(cli, cli->ackDelay);
+
+        // export the statistics every ST_INTERVAL milliseconds
+        st_tick();
+
+        // received eof, request the next file of the session if any
+        if (fin && cli->fileNext < cli->arg->nfiles)
+        {
+            SendDgSrvNextReq(cli);
+            finSeq = 0;
+        }
+        else if (fin)
+        {
+            st_export(1);
+            SendDgSrvFin(cli);
+            finSeq = 0;
         }
 
-        int ret = 0;
-        uint32_t ack = 0, ts = 0;
-        // put data to receive buffer
-        ret = WriteDgRcvBuf(cli->buf, &dg, cli->printSeq, &ack);
-        switch (ret)
+        if (closed)
+        {
+            printf("[Client]: Received FIN-ACK from server\n");
+            CloseDgClient(cli, frames);
+            return 0;
+        }
+    }
+
+    return 0;
+}
+
+// grow the slots of the multicast client to size, the new ones are empty
+// return -1 if there is no memory, the slots are kept
+int GrowDgMcastSlots(struct filedatagram ***slots, uint32_t *nslots, uint32_t size)
+{
+    struct filedatagram **p;
+
+    if (size <= *nslots)
+        return 0;
+    if ((p = realloc(*slots, size * sizeof(*p))) == NULL)
+        return -1;
+    memset(p + *nslots, 0, (size - *nslots) * sizeof(*p));
+    *slots = p;
+    *nslots = size;
+    return 0;
+}
+
+// send NACKs for all missing segments in [next, total] to the multicast sender
+void SendDgMcastNack(dg_client *cli, struct sockaddr *to, socklen_t len,
+                     struct filedatagram **slots, uint32_t next, uint32_t total, int round)
+{
+    struct filedatagram dg;
+    uint32_t *range = (uint32_t *)dg.data;
+    uint32_t seq = next;
+    int n = 0;
+
+    while (seq <= total)
+    {
+        bzero(&dg, DATAGRAM_HEADERSIZE);
+        dg.seq = cli->seq++;
+        dg.wnd = round;
+        dg.flag.nak = 1;
+
+        // collect at most MC_NACK_RANGES missing ranges
+        for (n = 0; n < (int)MC_NACK_RANGES && seq <= total; seq++)
         {
-        case DGBUF_RWND_FULL:   // sliding window size is zero
-            SendDgSrvAck(cli, cli->buf->nextSeq, dg.ts, cli->buf->rwnd.win, 1, "rwnd size is 0");
+            if (slots[seq] != NULL)
+                continue;
+            range[2 * n] = seq;
+            while (seq + 1 <= total && slots[seq + 1] == NULL)
+                seq++;
+            range[2 * n + 1] = seq;
+            n++;
+        }
+        if (n == 0)
+            break;
+        dg.len = 2 * n * sizeof(uint32_t);
+
+        if (cli->printSeq)
+            printf("[Client]: Send NACK round #%d, %d ranges [%d, %d]", round, n, range[0], range[2 * n - 1]);
+        if (DgRandom() > cli->arg->p)
+            Dg_sendpacket(cli->sock, to, len, &dg);
+        else if (cli->printSeq)
+            printf(" <DROPPED>");
+        if (cli->printSeq)
+            printf("\n");
+    }
+}
+
+int StartDgMcastCli(dg_client *cli)
+{
+    if (NULL == cli)
+        return -1;
+
+    struct filedatagram **slots = NULL;     // received segments, indexed by seq
+    struct filedatagram *dg = NULL;         // frame the next datagram is received into
+    struct sockaddr_in from;
+    struct timeval tv;
+    socklen_t len;
+    fd_set fds;
+    uint32_t nslots = 0, next = 1, total = 0;
+    int n = 0;
+
+    // initialize random
+    srandom(cli->arg->seed);
+
+    printf("[Client]: Join multicast group %s:%d\n", cli->arg->mcastIP, cli->arg->mcastPort);
+
+    while (total == 0 || next <= total)
+    {
+        FD_ZERO(&fds);
+        FD_SET(cli->sock, &fds);
+        tv.tv_sec = MCAST_TIMEOUT;
+        tv.tv_usec = 0;
+        n = select(cli->sock + 1, &fds, NULL, NULL, &tv);
+        if (n == -1 && errno == EINTR)
             continue;
+        if (n <= 0)
+        {
+            err_msg("[Client]: No response from multicast group %s:%d, giving up", cli->arg->mcastIP, cli->arg->mcastPort);
+            break;
+        }
 
-        case DGBUF_SEGMENT_IN_BUF:      // segment is already in receive buffer
-            SendDgSrvAck(cli, cli->buf->nextSeq, dg.ts, cli->buf->rwnd.win, 0, "already-in buffer");
+        // receive into a new frame, it becomes the slot if stored
+        if (dg == NULL)
+            dg = malloc(sizeof(*dg));
+        len = sizeof(from);
+        if ((n = recvfrom(cli->sock, dg, sizeof(*dg), 0, (SA *)&from, &len)) < (int)DATAGRAM_HEADERSIZE)
             continue;
+        dg->len = min(dg->len, n - DATAGRAM_HEADERSIZE);
 
-        case DGBUF_SEGMENT_OUTOFRANGE:  // segment is out of range
-            SendDgSrvAck(cli, cli->buf->nextSeq, dg.ts, cli->buf->rwnd.win, 0, "out-of-range");
+        if (cli->arg->p > 0 && DgRandom() <= cli->arg->p)
+        {
+            // discard the datagram
+            if (cli->printSeq)
+                printf("[Client]: Receive datagram #%d <DROPPED>\n", dg->seq);
             continue;
+        }
 
-        case DGBUF_SEGMENT_OUTOFORDER:  // out of order, send duplicate ack
-            SendDgSrvAck(cli, ack, cli->buf->ts, cli->buf->rwnd.win, 0, "out-of-order");
-            //break;
+        // received round end, report what is missing
+        if (dg->flag.rnd == 1)
+        {
+            // the number of datagrams comes from the network, the slots
+            // are sized by it
+            if (dg->ack == 0 || dg->ack > MC_MAXDATAGRAMS || (total != 0 && dg->ack != total))
+                continue;
+            total = dg->ack;
+            if (GrowDgMcastSlots(&slots, &nslots, total + 1) < 0)
+            {
+                err_msg("[Client]: No memory for %u datagrams", total);
+                break;
+            }
+            SendDgMcastNack(cli, (SA *)&from, len, slots, next, total, dg->wnd);
             continue;
         }
 
-        // get datagram from buffer
-        if (GetInOrderAck(cli->buf, &ack, &ts) == 0)
+        if (dg->seq == 0 || dg->seq > MC_MAXDATAGRAMS || (total != 0 && dg->seq > total) || dg->flag.nak == 1)
+            continue;
+
+        if (dg->flag.eof == 1)
+            total = dg->seq;
+
+        if (dg->seq >= nslots && GrowDgMcastSlots(&slots, &nslots, min(max(dg->seq + 1, nslots * 2), MC_MAXDATAGRAMS + 1)) < 0)
         {
-            SendDgSrvAck(cli, ack, ts, cli->buf->rwnd.win, 0, "in-order");
+            err_msg("[Client]: No memory for %u datagrams", dg->seq);
+            break;
         }
 
-                // received eof
-        if (dg.flag.eof == 1 && dg.seq +1 == cli->buf->nextSeq)
+        if (dg->seq < next || slots[dg->seq] != NULL)
         {
-            HandleDgClientFin(cli);
+            if (cli->printSeq)
+                printf("[Client]: Receive datagram #%d, is already received\n", dg->seq);
+            continue;
+        }
+
+        slots[dg->seq] = dg;
+        if (cli->printSeq)
+            printf("[Client]: Receive datagram #%d (ts = %d)%s\n", dg->seq, dg->ts, dg->flag.eof ? " <EOF>" : "");
+        dg = NULL;
+
+        // deliver in-order segments
+        while (next < nslots && slots[next] != NULL)
+        {
+            if (cli->printFile)
+                fwrite(slots[next]->data, 1, slots[next]->len, stdout);
+            free(slots[next]);
+            slots[next] = NULL;
+            next++;
         }
     }
 
+    free(dg);
+    free(slots);
+
+    if (total == 0 || next <= total)
+        return -1;
+
+    printf("[Client Print]: File data finished\n");
     return 0;
 }
@@ -12,6 +12,10 @@
 #include "udpfile.h"
 #include "dgbuffer.h"
 
+#define DELAYED_ACK_SEGS    2       // ack at least every 2 in-order segments
+#define DELAYED_ACK_USEC    1000    // hold an ack at most 1000 microseconds
+#define RCV_BATCH           32      // receive at most 32 datagrams per recvmmsg
+
 /**
 * @brief Define client arguments
 */
@@ -24,6 +28,10 @@ typedef struct dg_arg_t
     int      seed;                          // random generator seed value
     double   p;                             // probability p of datagram loss
     int      u;                             // an exponential distribution controlling the rate value
+    char     mcastIP[IP_BUFFSIZE];          // multicast group address, empty if unicast
+    int      mcastPort;                     // multicast group port
+    char   **files;                         // next filenames requested in the same session
+    int      nfiles;                        // # next filenames
 }dg_arg;
 
 /**
@@ -37,9 +45,26 @@ typedef struct dg_client_t
     dg_rcv_buf *buf;                // receive buffer object
     dg_rtt      rtt;                // rtt object
     uint32_t    seq;                // client segment sequence
-    timer_t     delayedAckTimer;    // delayed ack timer
+    int         ackTimer;           // delayed ack timer (timerfd)
+    int         ackArmed;           // 1 if delayed ack timer is armed
+    int         ackEvery;           // send an ack every N in-order segments
+    int         ackDelay;           // max delay of a pending ack, in microseconds
+    int         ackPending;         // # in-order segments not acked yet
+    uint32_t    ackRcvd;            // local time the last in-order segment arrived
+    uint16_t    ceCount;            // # datagrams received with a CE mark, echoed in acks
+    int         advWin;             // last advertised window size
+    int         rcvBatch;           // max # datagrams received per recvmmsg
+    int         gro;                // 1 if coalesced receive (UDP_GRO) is used
     int         sock;               // UDP socket
     int         newPort;            // new port number of server
+    uint32_t    cid;                // connection ID of the session, echoed in acks
+    int         fileNext;           // # next filenames requested
+    int         reqPending;         // 1 if the next file request is not answered yet
+    uint32_t    reqSeq;             // first seq of the next file
+    uint32_t    reqTs;              // timestamp of the next file request
+    int         finPending;         // 1 if the fin is not answered yet
+    int         finTries;           // # times the fin is resent
+    pthread_t   printTid;           // print thread
     int         timeout;            // time out value
     int         printSeq;           // print sequence flag, if 1 print on screen  
     int         printFile;          // print file content flag, if 1 print on screen
@@ -73,6 +98,13 @@ int InitDgCli(dg_client *cli);
 **/
 int StartDgCli(dg_client *cli);
 
+/**
+* @brief Start the client as a multicast receiver
+* @param[in] cli : dg_cli object, the socket is bound to the group
+* @return  0 if OK, -1 error
+**/
+int StartDgMcastCli(dg_client *cli);
+
 
 #endif // __DGCLI_IMPL_H_
 
@@ -0,0 +1,223 @@
+/*
+* @Author: Yinlong Su
+* @Date:   2015-10-29 09:31:07
+* @Last Modified by:   Yinlong Su
+* @Last Modified time: 2015-10-29 18:02:44
+*
+* File:         dgmcast.c
+* Description:  Multicast Distribution Server C file
+*/
+
+#include "udpfile.h"
+
+struct rtt_info mc_rttinfo;
+struct file_cache *mc_file = NULL;  // file to distribute
+uint32_t mc_total = 0;              // # datagrams of the file
+uint8_t  *mc_need = NULL;           // bitmap of datagrams NACKed in this round
+
+#define MC_SETBIT(map, i)   ((map)[(i) >> 3] |= (1 << ((i) & 7)))
+#define MC_GETBIT(map, i)   ((map)[(i) >> 3] & (1 << ((i) & 7)))
+
+/* --------------------------------------------------------------------------
+ *  mc_datagram
+ *
+ *  Multicast datagram build function
+ *
+ *  @param  : uint32_t              seq
+ *            struct filedatagram   *datagram
+ *  @return : void
+ *
+ *  # This is a static inline function
+ *  Fill the datagram #seq from the mapped file
+ * --------------------------------------------------------------------------
+ */
+static inline void mc_datagram(uint32_t seq, struct filedatagram *datagram) {
+    off_t off = (off_t)(seq - 1) * DATAGRAM_DATASIZE;
+
+    bzero(datagram, DATAGRAM_HEADERSIZE);
+    datagram->seq = seq;
+    datagram->len = min((off_t)DATAGRAM_DATASIZE, mc_file->size - off);
+    if (datagram->len > 0)
+        memcpy(datagram->data, mc_file->addr + off, datagram->len);
+    if (seq == mc_total)
+        datagram->flag.eof = 1;
+}
+
+/* --------------------------------------------------------------------------
+ *  mc_send
+ *
+ *  Multicast datagram send function
+ *
+ *  @param  : int                   sockfd
+ *            struct sockaddr_in    *group
+ *            struct filedatagram   *datagram
+ *  @return : void
+ *  @see    : function#Dg_sendpacket
+ *
+ *  Fill the timestamp and send it to the group
+ * --------------------------------------------------------------------------
+ */
+static void mc_send(int sockfd, struct sockaddr_in *group, struct filedatagram *datagram) {
+    datagram->ts = rtt_ts(&mc_rttinfo);
+    Dg_sendpacket(sockfd, (SA *)group, sizeof(*group), datagram);
+}
+
+/* --------------------------------------------------------------------------
+ *  mc_collect
+ *
+ *  Multicast NACK collect function
+ *
+ *  @param  : int       sockfd
+ *            uint32_t  ms      # collect time, in milliseconds
+ *  @return : int       # number of NACK datagrams received
+ *
+ *  Receive NACKs from all receivers for ms milliseconds and aggregate the
+ *  missing ranges into mc_need
+ * --------------------------------------------------------------------------
+ */
+static int mc_collect(int sockfd, uint32_t ms) {
+    int     n, i, naks = 0;
+    uint32_t    seq, first, last, *range;
+    uint32_t    end = rtt_ts(&mc_rttinfo) + ms, now;
+    fd_set  fds;
+    struct timeval      tv;
+    struct filedatagram FD;
+
+    while ((now = rtt_ts(&mc_rttinfo)) < end) {
+        tv.tv_sec = (end - now) / 1000;
+        tv.tv_usec = ((end - now) % 1000) * 1000;
+
+        FD_ZERO(&fds);
+        FD_SET(sockfd, &fds);
+        n = select(sockfd + 1, &fds, NULL, NULL, &tv);
+        if (n == -1 && errno == EINTR)
+            continue;
+        if (n == -1)
+            err_sys("select error");
+        if (n == 0)
+            break;
+
+        if (Dg_readpacket(sockfd, &FD) < (int)DATAGRAM_HEADERSIZE || FD.flag.nak != 1)
+            continue;
+
+        naks ++;
+        range = (uint32_t *)FD.data;
+        for (i = 0; i + 1 < (int)(FD.len / sizeof(uint32_t)); i += 2) {
+            first = max(range[i], 1);
+            last = min(range[i + 1], mc_total);
+            for (seq = first; seq <= last; seq++)
+                MC_SETBIT(mc_need, seq);
+        }
+    }
+    return naks;
+}
+
+/* --------------------------------------------------------------------------
+ *  Dg_mcast_serv
+ *
+ *  Multicast distribution function
+ *
+ *  @param  : char  *group      # multicast group address
+ *            int   mport       # multicast port
+ *            char  *ifaddr     # outgoing interface address, NULL for default
+ *            char  *filename
+ *            int   burst       # datagrams sent in one burst
+ *  @return : int               # 0 = fail
+ *
+ *  Stream the file to the group in rounds instead of forking one unicast
+ *  sender per client:
+ *      a. Send every pending datagram, burst datagrams every
+ *         MC_BURST_INTERVAL milliseconds
+ *      b. Send a round end datagram and collect NACKs for MC_NACK_WAIT
+ *         milliseconds, the missing ranges of all receivers are merged
+ *      c. The NACKed datagrams are the pending datagrams of next round
+ *      d. Finish after MC_QUIET_ROUNDS rounds without NACK
+ *  Receivers joining late recover everything they missed through NACKs.
+ * --------------------------------------------------------------------------
+ */
+int Dg_mcast_serv(char *group, int mport, char *ifaddr, char *filename, int burst) {
+    const int   on = 1;
+    const u_char    ttl = MC_TTL;
+    int         sockfd, naks, quiet = 0;
+    uint32_t    seq, round, sent;
+    struct in_addr      iface;
+    struct sockaddr_in  groupaddr, servaddr;
+    struct filedatagram FD;
+
+    if ((mc_file = fc_acquire(filename)) == NULL) {
+        printf("[Server Multicast]: Can not open file \"%s\".\n", filename);
+        return 0;
+    }
+    mc_total = max((mc_file->size + DATAGRAM_DATASIZE - 1) / DATAGRAM_DATASIZE, 1);
+    if (mc_total > MC_MAXDATAGRAMS) {
+        printf("[Server Multicast]: File \"%s\" is too large, at most %d datagrams.\n", filename, MC_MAXDATAGRAMS);
+        fc_release(mc_file);
+        return 0;
+    }
+    mc_need = Calloc((mc_total >> 3) + 1, 1);
+    if (burst <= 0)
+        burst = 1;
+
+    bzero(&groupaddr, sizeof(groupaddr));
+    groupaddr.sin_family = AF_INET;
+    groupaddr.sin_port = htons(mport);
+    Inet_pton(AF_INET, group, &groupaddr.sin_addr);
+
+    sockfd = Socket(AF_INET, SOCK_DGRAM, 0);
+    bzero(&servaddr, sizeof(servaddr));
+    servaddr.sin_family = AF_INET;
+    servaddr.sin_addr.s_addr = htonl(INADDR_ANY);
+    Bind(sockfd, (SA *)&servaddr, sizeof(servaddr));
+
+    Setsockopt(sockfd, IPPROTO_IP, IP_MULTICAST_LOOP, &on, sizeof(on));
+    Setsockopt(sockfd, IPPROTO_IP, IP_MULTICAST_TTL, &ttl, sizeof(ttl));
+    if (ifaddr) {
+        Inet_pton(AF_INET, ifaddr, &iface);
+        Setsockopt(sockfd, IPPROTO_IP, IP_MULTICAST_IF, &iface, sizeof(iface));
+    }
+
+    rtt_init(&mc_rttinfo);
+    printf("[Server Multicast]: Send \"%s\" (%u datagrams) to group %s:%d.\n", filename, mc_total, group, mport);
+
+    // every datagram is pending in the first round
+    memset(mc_need, 0xFF, (mc_total >> 3) + 1);
+
+    for (round = 1; round <= MC_MAXROUNDS; round++) {
+        // a. send pending datagrams
+        for (seq = 1, sent = 0; seq <= mc_total; seq++) {
+            if (!MC_GETBIT(mc_need, seq))
+                continue;
+            mc_datagram(seq, &FD);
+            mc_send(sockfd, &groupaddr, &FD);
+            if (++sent % burst == 0)
+                usleep(MC_BURST_INTERVAL * 1000);
+        }
+        bzero(mc_need, (mc_total >> 3) + 1);
+
+        // b. round end, collect NACKs
+        bzero(&FD, sizeof(FD));
+        FD.ack = mc_total;
+        FD.wnd = round;
+        FD.flag.rnd = 1;
+        mc_send(sockfd, &groupaddr, &FD);
+        naks = mc_collect(sockfd, MC_NACK_WAIT);
+
+        printf("[Server Multicast]: Round #%d, sent %u datagrams, received %d NACKs.\n", round, sent, naks);
+
+        // d. finish if no receiver is missing anything
+        if (naks > 0)
+            quiet = 0;
+        else if (++quiet >= MC_QUIET_ROUNDS)
+            break;
+    }
+
+    free(mc_need);
+    close(sockfd);
+    fc_release(mc_file);
+
+    if (round > MC_MAXROUNDS) {
+        printf("[Server Multicast]: Terminate for too many rounds.\n");
+        return 0;
+    }
+    return 1;
+}
@@ -0,0 +1,189 @@
+/*
+* @Author: Yinlong Su
+* @Date:   2015-11-02 14:20:37
+* @Last Modified by:   Yinlong Su
+* @Last Modified time: 2015-11-02 17:05:12
+*
+* File:         dgpath.c
+* Description:  Server Path Metrics Cache C file
+*/
+
+#include <sys/mman.h>
+#include "udpfile.h"
+
+int     pc_prefix = PC_PREFIX;          // prefix length of the key, 0 = disabled
+struct path_cache *pc_table = NULL;     // shared by the parent and all children
+
+/* --------------------------------------------------------------------------
+ *  pc_key
+ *
+ *  Path metrics cache key function
+ *
+ *  @param  : in_addr_t address # client IP address (network byte order)
+ *  @return : in_addr_t         # client network (network byte order)
+ *
+ *  # This is a static inline function
+ * --------------------------------------------------------------------------
+ */
+static inline in_addr_t pc_key(in_addr_t address) {
+    uint32_t mask = pc_prefix >= 32 ? 0xFFFFFFFFu : ~(0xFFFFFFFFu >> pc_prefix);
+
+    return address & htonl(mask);
+}
+
+/* --------------------------------------------------------------------------
+ *  pc_slot
+ *
+ *  Path metrics cache slot function
+ *
+ *  @param  : in_addr_t key
+ *  @return : struct path_metrics * # the entry of the key, a new network
+ *                                  # replaces the one in its slot
+ *
+ *  # This is a static inline function
+ * --------------------------------------------------------------------------
+ */
+static inline struct path_metrics *pc_slot(in_addr_t key) {
+    uint32_t h = (uint32_t)key * 2654435761u;
+
+    return &pc_table->entry[(h >> 16) & (PC_ENTRIES - 1)];
+}
+
+/* --------------------------------------------------------------------------
+ *  pc_lock
+ *
+ *  Path metrics cache lock function
+ *
+ *  @param  : void
+ *  @return : int   # 1 if the table is locked
+ *
+ *  The mutex is robust: a child killed while holding it does not block
+ *  the others. The entry it was writing may be torn, so all entries are
+ *  dropped and the mutex is made consistent again.
+ *
+ *  # This is a static function
+ * --------------------------------------------------------------------------
+ */
+static int pc_lock() {
+    int r = pthread_mutex_lock(&pc_table->mutex);
+
+    if (r == EOWNERDEAD) {
+        bzero(pc_table->entry, sizeof(pc_table->entry));
+        pthread_mutex_consistent(&pc_table->mutex);
+        printf("[Server]: Path metrics cache owner died, entries dropped.\n");
+        r = 0;
+    }
+    return r == 0;
+}
+
+/* --------------------------------------------------------------------------
+ *  pc_init
+ *
+ *  Path metrics cache initialization
+ *
+ *  @param  : int   prefix  # prefix length of the key, 0 = disabled
+ *  @return : void
+ *
+ *  Map the table shared and anonymous before any fork, so every child
+ *  sees the same entries. The entries are protected by one process-shared
+ *  robust mutex, a lookup or an update only copies one entry.
+ * --------------------------------------------------------------------------
+ */
+void pc_init(int prefix) {
+    pthread_mutexattr_t attr;
+
+    pc_prefix = prefix;
+    if (pc_prefix <= 0)
+        return;
+
+    pc_table = mmap(NULL, sizeof(struct path_cache), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (pc_table == MAP_FAILED) {
+        printf("[Server]: Path metrics cache is not available (%s).\n", strerror(errno));
+        pc_table = NULL;
+        return;
+    }
+
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+    pthread_mutexattr_setrobust(&attr, PTHREAD_MUTEX_ROBUST);
+    pthread_mutex_init(&pc_table->mutex, &attr);
+    pthread_mutexattr_destroy(&attr);
+
+    printf("[Server]: Path metrics cache of %d entries, keyed by /%d networks.\n", PC_ENTRIES, pc_prefix);
+}
+
+/* --------------------------------------------------------------------------
+ *  pc_lookup
+ *
+ *  Path metrics cache lookup function
+ *
+ *  @param  : in_addr_t             address # client IP address
+ *            struct path_metrics   *pm     # copy of the entry
+ *  @return : int   # 1 if an entry of the client network is not expired
+ * --------------------------------------------------------------------------
+ */
+int pc_lookup(in_addr_t address, struct path_metrics *pm) {
+    in_addr_t key;
+    struct path_metrics *e;
+    int found = 0;
+
+    if (pc_table == NULL)
+        return 0;
+
+    key = pc_key(address);
+    e = pc_slot(key);
+
+    if (!pc_lock())
+        return 0;
+    if (e->updated != 0 && e->key == key && time(NULL) - e->updated < PC_TTL) {
+        memcpy(pm, e, sizeof(*pm));
+        found = 1;
+    }
+    pthread_mutex_unlock(&pc_table->mutex);
+
+    return found;
+}
+
+/* --------------------------------------------------------------------------
+ *  pc_update
+ *
+ *  Path metrics cache update function
+ *
+ *  @param  : in_addr_t             address # client IP address
+ *            struct path_metrics   *pm     # metrics of the session,
+ *                                          # NULL to forget the network
+ *  @return : void
+ *
+ *  srtt and rttvar are averaged with a fresh entry of the same network
+ *  (3/4 old, 1/4 new), ssthresh and cwnd are the ones of the last session
+ * --------------------------------------------------------------------------
+ */
+void pc_update(in_addr_t address, const struct path_metrics *pm) {
+    in_addr_t key;
+    struct path_metrics *e;
+    time_t now = time(NULL);
+
+    if (pc_table == NULL)
+        return;
+
+    key = pc_key(address);
+    e = pc_slot(key);
+
+    if (!pc_lock())
+        return;
+    if (pm == NULL) {
+        if (e->key == key)
+            e->updated = 0;
+    } else if (e->updated != 0 && e->key == key && now - e->updated < PC_TTL) {
+        e->srtt = (3 * e->srtt + pm->srtt) >> 2;
+        e->rttvar = (3 * e->rttvar + pm->rttvar) >> 2;
+        e->ssthresh = pm->ssthresh;
+        e->cwnd = pm->cwnd;
+        e->updated = now;
+    } else {
+        memcpy(e, pm, sizeof(*e));
+        e->key = key;
+        e->updated = now;
+    }
+    pthread_mutex_unlock(&pc_table->mutex);
+}
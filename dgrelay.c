@@ -0,0 +1,513 @@
+/*
+* @Author: Yinlong Su
+* @Date:   2015-11-02 14:05:31
+* @Last Modified by:   Yinlong Su
+* @Last Modified time: 2015-11-02 21:47:12
+*
+* File:         dgrelay.c
+* Description:  Datagram Impairment Relay C file
+*/
+
+#define _GNU_SOURCE     // ppoll
+#include <poll.h>
+#include "udpfile.h"
+
+uint32_t    rl_delay = 0;           // one-way delay (half the RTT), in microseconds
+uint32_t    rl_jitter = 0;          // max extra delay, in microseconds
+double      rl_loss_good = 0.0;     // loss probability in the good state
+double      rl_loss_bad = 1.0;      // loss probability in the bad state
+double      rl_p_gb = 0.0;          // probability of good -> bad, per datagram
+double      rl_p_bg = 1.0;          // probability of bad -> good, per datagram
+double      rl_reorder = 0.0;       // probability a datagram is held back
+uint32_t    rl_reorder_delay = 5000;    // extra delay of a held back datagram, in microseconds
+uint64_t    rl_rate = 0;            // bottleneck rate in bytes per second, 0 = unlimited
+int         rl_queue = RL_QUEUELEN; // bottleneck queue, in datagrams
+int         rl_mark = 0;            // CE marking threshold, in datagrams, 0 = no marking
+unsigned short rl_seed[3] = { 0x330E, 0, 0 };
+
+int         rl_listenfd;
+struct sockaddr_in  rl_server;      // server listening address
+struct rl_link      rl_up, rl_down; // client -> server, server -> client
+struct rl_session   rl_sessions[RL_MAXSESSIONS];
+struct dg_slab      *rl_slab = NULL;
+volatile sig_atomic_t rl_stop = 0;
+
+/* --------------------------------------------------------------------------
+ *  usage
+ *
+ *  Print usage
+ *
+ *  @param  : void
+ *  @return : void
+ * --------------------------------------------------------------------------
+ */
+void usage() {
+    printf("Usage: dgrelay [options] port server_ip server_port\n");
+    printf("Options:\n");
+    printf("  -r ms    round trip time added, half in each direction\n");
+    printf("  -j ms    jitter, a random extra delay of 0 ~ ms\n");
+    printf("  -l p     loss probability (in the good state)\n");
+    printf("  -g p     Gilbert-Elliott probability of good -> bad state\n");
+    printf("  -e p     Gilbert-Elliott probability of bad -> good state (default 1)\n");
+    printf("  -L p     loss probability in the bad state (default 1)\n");
+    printf("  -o p     reorder probability, the datagram is held back\n");
+    printf("  -O ms    extra delay of a reordered datagram (default 5)\n");
+    printf("  -R kbps  bottleneck rate in kbit/s (default unlimited)\n");
+    printf("  -q n     bottleneck queue in datagrams (default %d)\n", RL_QUEUELEN);
+    printf("  -K n     mark ECN capable datagrams CE at n queued datagrams (default no marking)\n");
+    printf("  -s seed  random seed\n");
+    printf("  -h       display this help\n");
+
+    exit(0);
+}
+
+/* --------------------------------------------------------------------------
+ *  rl_now
+ *
+ *  Get the monotonic time in microseconds
+ *
+ *  @param  : void
+ *  @return : uint64_t
+ * --------------------------------------------------------------------------
+ */
+uint64_t rl_now() {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+void rl_sigstop(int signo __attribute__((unused))) {
+    rl_stop = 1;
+}
+
+/* --------------------------------------------------------------------------
+ *  rl_enqueue
+ *
+ *  Impair one datagram and queue it
+ *
+ *  @param  : struct rl_link        *l      # direction
+ *            int                   fd      # socket it is sent from
+ *            struct sockaddr_in    *to
+ *            char                  *data
+ *            int                   len
+ *            uint8_t               tos     # TOS byte received
+ *  @return : void
+ *
+ *  The Gilbert-Elliott channel changes its state, then the datagram is lost
+ *  with the loss probability of the state. It waits for the bottleneck
+ *  (tail drop if the queue is full, CE mark if it is ECN capable and the
+ *  queue is over the marking threshold), then for the delay and jitter. Jitter
+ *  does not reorder: the datagram is released after the previous one,
+ *  unless it is picked to be held back
+ * --------------------------------------------------------------------------
+ */
+void rl_enqueue(struct rl_link *l, int fd, struct sockaddr_in *to, char *data, int len, uint8_t tos) {
+    uint64_t    now = rl_now(), t = now;
+    struct rl_packet    *p, **pp;
+
+    if (l->bad) {
+        if (erand48(rl_seed) < rl_p_bg)
+            l->bad = 0;
+    } else if (erand48(rl_seed) < rl_p_gb)
+        l->bad = 1;
+    if (erand48(rl_seed) < (l->bad ? rl_loss_bad : rl_loss_good)) {
+        l->lost ++;
+        return;
+    }
+
+    if (rl_rate) {
+        if (l->free_at < now)
+            l->free_at = now;
+        if ((l->free_at - now) * rl_rate / 1000000 + len > (uint64_t)rl_queue * DATAGRAM_PAYLOAD) {
+            l->queue_drops ++;
+            return;
+        }
+        if (rl_mark > 0 && (tos & IPTOS_ECN_MASK) != IPTOS_ECN_NOT_ECT
+            && (l->free_at - now) * rl_rate / 1000000 >= (uint64_t)rl_mark * DATAGRAM_PAYLOAD) {
+            tos |= IPTOS_ECN_CE;
+            l->ce_marked ++;
+        }
+        l->free_at += (uint64_t)len * 1000000 / rl_rate;
+        t = l->free_at;
+    }
+
+    t += rl_delay;
+    if (rl_jitter)
+        t += (uint64_t)(erand48(rl_seed) * rl_jitter);
+    if (rl_reorder > 0 && erand48(rl_seed) < rl_reorder) {
+        t += rl_reorder_delay;
+        l->reordered ++;
+    } else {
+        if (t < l->last)
+            t = l->last;
+        l->last = t;
+    }
+
+    p = sl_alloc(rl_slab);
+    p->release = t;
+    p->fd = fd;
+    p->to = *to;
+    p->len = len;
+    p->tos = tos;
+    memcpy(p->data, data, len);
+
+    // mostly appended, a held back datagram is passed by the later ones
+    if (l->tail == NULL || l->tail->release <= t) {
+        p->next = NULL;
+        if (l->tail)
+            l->tail->next = p;
+        else
+            l->head = p;
+        l->tail = p;
+        return;
+    }
+    for (pp = &l->head; (*pp)->release <= t; pp = &(*pp)->next)
+        ;
+    p->next = *pp;
+    *pp = p;
+}
+
+/* --------------------------------------------------------------------------
+ *  rl_release
+ *
+ *  Send the queued datagrams whose release time has come
+ *
+ *  @param  : struct rl_link    *l
+ *            uint64_t          now
+ *  @return : void
+ *
+ *  The TOS byte received is sent again with the datagram, so the ECN field
+ *  (and a CE mark of the relay) gets to the peer
+ * --------------------------------------------------------------------------
+ */
+void rl_release(struct rl_link *l, uint64_t now) {
+    struct rl_packet    *p;
+    struct msghdr       msg;
+    struct iovec        iov;
+    struct cmsghdr      *cmsg;
+    char        ctrl[CMSG_SPACE(sizeof(int))];
+
+    while ((p = l->head) != NULL && p->release <= now) {
+        l->head = p->next;
+        if (l->head == NULL)
+            l->tail = NULL;
+
+        bzero(&msg, sizeof(msg));
+        iov.iov_base = p->data;
+        iov.iov_len = p->len;
+        msg.msg_name = &p->to;
+        msg.msg_namelen = sizeof(p->to);
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        if (p->tos) {
+            bzero(ctrl, sizeof(ctrl));
+            msg.msg_control = ctrl;
+            msg.msg_controllen = sizeof(ctrl);
+            cmsg = CMSG_FIRSTHDR(&msg);
+            cmsg->cmsg_level = IPPROTO_IP;
+            cmsg->cmsg_type = IP_TOS;
+            cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+            *(int *)CMSG_DATA(cmsg) = p->tos;
+        }
+
+        // the peer may be gone, the error is not the relay's business
+        if (sendmsg(p->fd, &msg, 0) == p->len)
+            l->forwarded ++;
+        sl_free(rl_slab, p);
+    }
+}
+
+/* --------------------------------------------------------------------------
+ *  rl_recvtos
+ *
+ *  Receive the TOS byte of every datagram on a socket
+ *
+ *  @param  : int   fd
+ *  @return : void
+ * --------------------------------------------------------------------------
+ */
+void rl_recvtos(int fd) {
+    const int on = 1;
+
+    Setsockopt(fd, IPPROTO_IP, IP_RECVTOS, &on, sizeof(on));
+}
+
+/* --------------------------------------------------------------------------
+ *  rl_session_get
+ *
+ *  Find the session of a client, or open a new one
+ *
+ *  @param  : struct sockaddr_in    *cli
+ *  @return : struct rl_session *   # NULL if there are RL_MAXSESSIONS
+ * --------------------------------------------------------------------------
+ */
+struct rl_session *rl_session_get(struct sockaddr_in *cli) {
+    struct rl_session   *s, *free_s = NULL;
+
+    for (s = rl_sessions; s < rl_sessions + RL_MAXSESSIONS; s++) {
+        if (!s->used) {
+            if (free_s == NULL)
+                free_s = s;
+        } else if (s->cli.sin_addr.s_addr == cli->sin_addr.s_addr && s->cli.sin_port == cli->sin_port)
+            return s;
+    }
+    if ((s = free_s) == NULL)
+        return NULL;
+
+    bzero(s, sizeof(*s));
+    s->used = 1;
+    s->cli = *cli;
+    s->upfd = Socket(AF_INET, SOCK_DGRAM, 0);
+    rl_recvtos(s->upfd);
+    s->downfd = -1;
+    printf("[Relay]: New session of client %s:%d.\n", inet_ntoa(cli->sin_addr), ntohs(cli->sin_port));
+    return s;
+}
+
+void rl_session_close(struct rl_session *s) {
+    printf("[Relay]: Close session of client %s:%d.\n", inet_ntoa(s->cli.sin_addr), ntohs(s->cli.sin_port));
+    close(s->upfd);
+    if (s->downfd >= 0)
+        close(s->downfd);
+    s->used = 0;
+}
+
+/* --------------------------------------------------------------------------
+ *  rl_port
+ *
+ *  Rewrite the port number of the server
+ *
+ *  @param  : struct rl_session     *s
+ *            struct filedatagram   *dg     # datagram with the port flag
+ *  @return : void
+ *
+ *  The data datagrams carry the private port of the server child in ack
+ *  until the client ACKs. Remember it and replace it by the private port
+ *  of the relay for this session
+ * --------------------------------------------------------------------------
+ */
+void rl_port(struct rl_session *s, struct filedatagram *dg) {
+    struct sockaddr_in  addr;
+    socklen_t   len = sizeof(addr);
+
+    if (s->downfd < 0) {
+        s->downfd = Socket(AF_INET, SOCK_DGRAM, 0);
+        rl_recvtos(s->downfd);
+        bzero(&addr, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_ANY);
+        Bind(s->downfd, (SA *)&addr, sizeof(addr));
+        if (getsockname(s->downfd, (SA *)&addr, &len) < 0)
+            err_sys("getsockname error");
+        s->child = rl_server;
+        s->child.sin_port = htons(dg->ack);
+        printf("[Relay]: Server private port %d -> relay private port %d.\n", dg->ack, ntohs(addr.sin_port));
+    } else if (getsockname(s->downfd, (SA *)&addr, &len) < 0)
+        err_sys("getsockname error");
+
+    dg->ack = ntohs(addr.sin_port);
+}
+
+/* --------------------------------------------------------------------------
+ *  rl_recv
+ *
+ *  Receive and queue all datagrams waiting on a socket
+ *
+ *  @param  : int                   fd
+ *            struct rl_session     *s  # NULL for the listening socket
+ *  @return : void
+ * --------------------------------------------------------------------------
+ */
+void rl_recv(int fd, struct rl_session *s) {
+    struct filedatagram dg;
+    struct sockaddr_in  from;
+    struct msghdr       msg;
+    struct iovec        iov;
+    struct cmsghdr      *cmsg;
+    char        ctrl[CMSG_SPACE(sizeof(int))];
+    uint8_t     tos;
+    int         n;
+
+    for ( ; ; ) {
+        bzero(&msg, sizeof(msg));
+        iov.iov_base = &dg;
+        iov.iov_len = DATAGRAM_PAYLOAD;
+        msg.msg_name = &from;
+        msg.msg_namelen = sizeof(from);
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        msg.msg_control = ctrl;
+        msg.msg_controllen = sizeof(ctrl);
+        if ((n = recvmsg(fd, &msg, MSG_DONTWAIT)) < 0)
+            return;
+        Dg_checkpacket(&dg, n);
+
+        tos = 0;
+        for (cmsg = CMSG_FIRSTHDR(&msg); cmsg != NULL; cmsg = CMSG_NXTHDR(&msg, cmsg))
+            if (cmsg->cmsg_level == IPPROTO_IP && cmsg->cmsg_type == IP_TOS)
+                tos = *(uint8_t *)CMSG_DATA(cmsg);
+
+        if (s == NULL) {
+            // request of a client
+            if ((s = rl_session_get(&from)) == NULL)
+                continue;
+            rl_enqueue(&rl_up, s->upfd, &rl_server, (char *)&dg, n, tos);
+            s->last = time(NULL);
+            s = NULL;
+        } else if (fd == s->upfd) {
+            // from the server, on the listening port or the child port;
+            // once the client knows the private port of the relay it only
+            // accepts datagrams from it, even if the child replies from the
+            // well-known port (single-port mode, server -s)
+            if (n >= (int)DATAGRAM_HEADERSIZE && dg.flag.pot == 1)
+                rl_port(s, &dg);
+            if (s->downfd >= 0)
+                rl_enqueue(&rl_down, s->downfd, &s->cli, (char *)&dg, n, tos);
+            else if (from.sin_port == rl_server.sin_port)
+                rl_enqueue(&rl_down, rl_listenfd, &s->cli, (char *)&dg, n, tos);
+            s->last = time(NULL);
+        } else {
+            // from the client, to the server child
+            rl_enqueue(&rl_up, s->upfd, &s->child, (char *)&dg, n, tos);
+            s->last = time(NULL);
+        }
+    }
+}
+
+void rl_stats(char *name, struct rl_link *l) {
+    printf("[Relay]: %s: forwarded = %lu, lost = %lu, queue drops = %lu, reordered = %lu, CE marked = %lu\n",
+        name, l->forwarded, l->lost, l->queue_drops, l->reordered, l->ce_marked);
+}
+
+int main(int argc, char **argv) {
+    struct pollfd       fds[1 + 2 * RL_MAXSESSIONS];
+    struct rl_session   *owner[1 + 2 * RL_MAXSESSIONS];
+    struct sockaddr_in  addr;
+    struct timespec     ts;
+    uint64_t    now, next;
+    int         c, i, n;
+    time_t      t;
+
+    while ((c = getopt(argc, argv, "r:j:l:g:e:L:o:O:R:q:K:s:h?")) != -1) {
+        switch (c) {
+        case 'r':
+            rl_delay = atof(optarg) * 1000 / 2;
+            break;
+        case 'j':
+            rl_jitter = atof(optarg) * 1000;
+            break;
+        case 'l':
+            rl_loss_good = atof(optarg);
+            break;
+        case 'g':
+            rl_p_gb = atof(optarg);
+            break;
+        case 'e':
+            rl_p_bg = atof(optarg);
+            break;
+        case 'L':
+            rl_loss_bad = atof(optarg);
+            break;
+        case 'o':
+            rl_reorder = atof(optarg);
+            break;
+        case 'O':
+            rl_reorder_delay = atof(optarg) * 1000;
+            break;
+        case 'R':
+            rl_rate = atof(optarg) * 1000 / 8;
+            break;
+        case 'q':
+            rl_queue = atoi(optarg);
+            break;
+        case 'K':
+            rl_mark = atoi(optarg);
+            break;
+        case 's':
+            n = atoi(optarg);
+            rl_seed[1] = n & 0xFFFF;
+            rl_seed[2] = (n >> 16) & 0xFFFF;
+            break;
+        default:
+            usage();
+            break;
+        }
+    }
+    if (argc - optind != 3)
+        usage();
+
+    bzero(&rl_server, sizeof(rl_server));
+    rl_server.sin_family = AF_INET;
+    rl_server.sin_port = htons(atoi(argv[optind + 2]));
+    Inet_pton(AF_INET, argv[optind + 1], &rl_server.sin_addr);
+
+    rl_listenfd = Socket(AF_INET, SOCK_DGRAM, 0);
+    bzero(&addr, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    addr.sin_port = htons(atoi(argv[optind]));
+    Bind(rl_listenfd, (SA *)&addr, sizeof(addr));
+    rl_recvtos(rl_listenfd);
+
+    rl_slab = sl_create(sizeof(struct rl_packet), 0);
+    Signal(SIGINT, rl_sigstop);
+    Signal(SIGTERM, rl_sigstop);
+
+    printf("[Relay]: Port %s -> server %s:%s, rtt = %d ms, jitter = %d ms, loss = %g (bad %g, %g -> bad -> %g), reorder = %g, rate = %lu kbit/s, CE mark = %d.\n",
+        argv[optind], argv[optind + 1], argv[optind + 2], rl_delay * 2 / 1000, rl_jitter / 1000,
+        rl_loss_good, rl_loss_bad, rl_p_gb, rl_p_bg, rl_reorder, rl_rate * 8 / 1000, rl_mark);
+
+    while (!rl_stop) {
+        n = 0;
+        fds[n].fd = rl_listenfd;
+        fds[n].events = POLLIN;
+        owner[n++] = NULL;
+        for (i = 0; i < RL_MAXSESSIONS; i++) {
+            if (!rl_sessions[i].used)
+                continue;
+            fds[n].fd = rl_sessions[i].upfd;
+            fds[n].events = POLLIN;
+            owner[n++] = &rl_sessions[i];
+            if (rl_sessions[i].downfd >= 0) {
+                fds[n].fd = rl_sessions[i].downfd;
+                fds[n].events = POLLIN;
+                owner[n++] = &rl_sessions[i];
+            }
+        }
+
+        // sleep until the next release, at most a second for idle sessions
+        now = rl_now();
+        next = now + 1000000;
+        if (rl_up.head && rl_up.head->release < next)
+            next = rl_up.head->release;
+        if (rl_down.head && rl_down.head->release < next)
+            next = rl_down.head->release;
+        next = next > now ? next - now : 0;
+        ts.tv_sec = next / 1000000;
+        ts.tv_nsec = (next % 1000000) * 1000;
+
+        if (ppoll(fds, n, &ts, NULL) < 0) {
+            if (errno == EINTR)
+                continue;
+            err_sys("ppoll error");
+        }
+
+        for (i = 0; i < n; i++)
+            if (fds[i].revents & POLLIN)
+                rl_recv(fds[i].fd, owner[i]);
+
+        now = rl_now();
+        rl_release(&rl_up, now);
+        rl_release(&rl_down, now);
+
+        t = time(NULL);
+        for (i = 0; i < RL_MAXSESSIONS; i++)
+            if (rl_sessions[i].used && t - rl_sessions[i].last > RL_IDLE)
+                rl_session_close(&rl_sessions[i]);
+    }
+
+    rl_stats("client -> server", &rl_up);
+    rl_stats("server -> client", &rl_down);
+    return 0;
+}
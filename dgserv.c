@@ -8,19 +8,59 @@
 * Description:  Datagram Server C file
 */
 
+#include <sys/mman.h>
+#include <setjmp.h>
+#include <linux/io_uring.h>
 #include "udpfile.h"
 
 int     pfd[2];
 pid_t   pid;
 char    IPserver[IP_BUFFSIZE], IPclient[IP_BUFFSIZE];
-FILE    *fp;
+FILE    *fp = NULL;
+struct file_cache *fcache = NULL;   // cached file mapped by the parent
+sigjmp_buf fc_jmpbuf;               // the session ends here if the mapping faults
+off_t   buff_off = 0;               // offset of the next byte to buffer
+char    buff_eof = 0;               // 1 if all file contents are buffered
+
+uint8_t gso_enable = 1;             // 1 if bursts are sent with UDP_SEGMENT
+uint8_t ur_enable = 0;              // 1 if the io_uring backend is requested
+uint8_t ecn_enable = 1;             // 1 if the data datagrams are marked ECN capable
+int     ur_file = -1;               // file read through io_uring, -1 if not used
+off_t   ur_size = 0;                // size of ur_file
+struct ur_send ur_sends[UR_MAXSENDS];   // sends in flight
+
+int     pf_windows = PF_WINDOWS;    // read-ahead depth in windows, 0 = disabled
+off_t   pf_depth = 0;               // read-ahead depth of this transfer, in bytes
+off_t   pf_off = 0;                 // offset of the next byte to prefetch
+off_t   pf_size = 0;                // size of the file
+
+uint8_t sl_hugepage = 0;            // 1 if the sender window slab uses huge pages
+struct dg_slab *swnd_slab = NULL;   // sender window nodes
+
+uint16_t port_pending = 0;          // private port carried by the data datagrams until the first ACK
+uint32_t conn_id = 0;               // connection ID of the session
+uint8_t sp_enable = 0;              // 1 if the children reply from the well-known port
+int     sp_fd = -1;                 // unix socket of the datagrams routed by the parent, -1 if not used
+
+uint32_t ka_files = 0;              // # files sent in this session
+char    ka_file[FILENAME_BUFFSIZE]; // next file requested, empty if none
+uint16_t ka_wnd = 0;                // advertised window of the next file request
+char    ka_fin = 0;                 // 1 if the client has closed the session
+
+struct path_metrics pc_seed;        // path metrics of an earlier session to the client network
+char    pc_found = 0;               // 1 if pc_seed is valid
 
 char    rttinit = 0;
 struct rtt_info rttinfo;
 uint32_t buff_seq = 0;
 struct sender_window *swnd_head = NULL, *swnd_now = NULL, *swnd_tail = NULL;
+uint32_t tlp_seq = 0;               // seq of the tail loss probe in flight, 0 if none
+uint32_t rto_seq = 0;               // seq of the datagram resent on timeout
+uint32_t rto_ts = 0;                // timestamp of its first retransmission, 0 if none
 
-extern uint8_t rto_display;
+char    *tr_prefix = NULL;          // binary trace file prefix, NULL if not traced
+char    *st_dir = NULL;             // directory of the metrics files, NULL if not exported
+extern char *st_path;
 
 /* --------------------------------------------------------------------------
  *  Dg_cli_read
@@ -96,6 +136,228 @@ void Dg_serv_send(int sockfd, const SA* cliaddr, socklen_t clilen, struct fileda
     Dg_sendpacket(sockfd, cliaddr, clilen, datagram);
 }
 
+/* --------------------------------------------------------------------------
+ *  Dg_serv_reap
+ *
+ *  Server io_uring completion handle function
+ *
+ *  @param  : unsigned  wait    # wait for at least wait completions
+ *  @return : void
+ *
+ *  Submit the queued file reads and sends, then handle the completions:
+ *      a. A finished read clears the pending flag of the datagram, a short
+ *         read is done again with pread() at the offset of the datagram
+ *         (the seq goes on across the files of a session)
+ *      b. A finished send releases its ur_send and the window nodes it
+ *         read, a node ACKed meanwhile is freed here (see Dg_serv_ack).
+ *         A failed send is only reported since the datagrams are resent
+ *         on timeout
+ * --------------------------------------------------------------------------
+ */
+void Dg_serv_reap(unsigned wait) {
+    int         res;
+    size_t      i;
+    uint64_t    data;
+    struct ur_send          *us;
+    struct sender_window    *swnd;
+
+    if (ur_submit(wait) < 0 && errno != EINTR && errno != EAGAIN && errno != EBUSY)
+        err_sys("io_uring_enter error");
+
+    while (ur_cqe(&data, &res)) {
+        if (data & 1) {
+            // a. send
+            us = &ur_sends[data >> 1];
+            us->busy = 0;
+            for (i = 0; i < us->msg.msg_iovlen; i++) {
+                swnd = us->iov[i].iov_base;
+                if (--swnd->sending == 0 && swnd->acked)
+                    sl_free(swnd_slab, swnd);
+            }
+            if (res >= 0)
+                continue;
+            if (us->msg.msg_controllen > 0 && (-res == EIO || -res == EINVAL || -res == EOPNOTSUPP)) {
+                gso_enable = 0;
+                printf("[Server Child #%d]: UDP_SEGMENT send failed, send datagrams one by one.\n", pid);
+            } else
+                printf("[Server Child #%d]: io_uring send error: %s.\n", pid, strerror(-res));
+        } else {
+            // b. file read
+            swnd = (struct sender_window *)(uintptr_t)data;
+            if (res != swnd->datagram.len &&
+                pread(ur_file, swnd->datagram.data, swnd->datagram.len, swnd->off) != swnd->datagram.len)
+                err_sys("read error");
+            swnd->pending = 0;
+        }
+    }
+}
+
+/* --------------------------------------------------------------------------
+ *  Dg_serv_queue
+ *
+ *  Server io_uring send function
+ *
+ *  @param  : int           sockfd
+ *            struct iovec  *iov    # one datagram per iovec
+ *            int           n       # number of datagrams
+ *  @return : void
+ *  @see    : function#Dg_gsomsg
+ *
+ *  Queue a send of n datagrams (a UDP_SEGMENT burst if n > 1), it is
+ *  submitted with the other sends of the cycle by Dg_serv_reap
+ * --------------------------------------------------------------------------
+ */
+void Dg_serv_queue(int sockfd, struct iovec *iov, int n) {
+    int     i;
+    struct ur_send      *us = NULL;
+    struct io_uring_sqe *sqe;
+
+    // wait until a send is finished if all are in flight
+    while (us == NULL) {
+        for (i = 0; i < UR_MAXSENDS && us == NULL; i++)
+            if (!ur_sends[i].busy)
+                us = &ur_sends[i];
+        if (us == NULL)
+            Dg_serv_reap(1);
+    }
+
+    memcpy(us->iov, iov, n * sizeof(*iov));
+    if (n > 1)
+        Dg_gsomsg(&us->msg, us->iov, n, us->ctrl);
+    else {
+        bzero(&us->msg, sizeof(us->msg));
+        us->msg.msg_iov = us->iov;
+        us->msg.msg_iovlen = 1;
+    }
+
+    if ((sqe = ur_sqe()) == NULL) {
+        // submission queue is full, send it now
+        if (sendmsg(sockfd, &us->msg, 0) < 0)
+            printf("[Server Child #%d]: sendmsg error: %s.\n", pid, strerror(errno));
+        return;
+    }
+    sqe->opcode = IORING_OP_SENDMSG;
+    sqe->fd = sockfd;
+    sqe->addr = (uintptr_t)&us->msg;
+    sqe->len = 1;
+    sqe->user_data = ((uint64_t)(us - ur_sends) << 1) | 1;
+    us->busy = 1;
+    // the kernel reads the datagrams from the window nodes until the
+    // completion, so they must not be freed before
+    for (i = 0; i < n; i++)
+        ((struct sender_window *)us->iov[i].iov_base)->sending++;
+}
+
+/* --------------------------------------------------------------------------
+ *  Dg_serv_burst
+ *
+ *  Server datagram burst send function
+ *
+ *  @param  : int                   sockfd
+ *            struct sender_window  *swnd   # first datagram to send
+ *            uint32_t              limit   # send datagrams with seq < limit
+ *  @return : int                   # number of datagrams sent
+ *  @see    : function#Dg_writepacket_gso
+ *
+ *  Fill the timestamp and send up to GSO_MAXSEGS consecutive datagrams
+ *  with one system call. Only the last datagram of a burst may be short,
+ *  and a burst stops before a datagram whose file read is in flight.
+ *  With the io_uring backend the burst is queued instead (Dg_serv_queue).
+ *  If the kernel refuses the burst, send the datagrams one by one, and
+ *  stop using UDP_SEGMENT if it is not supported.
+ * --------------------------------------------------------------------------
+ */
+int Dg_serv_burst(int sockfd, struct sender_window *swnd, uint32_t limit) {
+    int     i, n = 0, segs = gso_enable ? GSO_MAXSEGS : 1;
+    uint32_t    ts = rtt_ts(&rttinfo);
+    struct iovec    iov[GSO_MAXSEGS];
+
+    for ( ; swnd && swnd->datagram.seq < limit && !swnd->pending && n < segs; swnd = swnd->next) {
+        swnd->datagram.ts = ts;
+        iov[n].iov_base = &swnd->datagram;
+        iov[n].iov_len = DATAGRAM_HEADERSIZE + swnd->datagram.len;
+        st_xfer.bytes_sent += swnd->datagram.len;
+        n++;
+        if (swnd->datagram.len < DATAGRAM_DATASIZE)
+            break;
+    }
+    st_xfer.dg_sent += n;
+
+    if (ur_file >= 0) {
+        Dg_serv_queue(sockfd, iov, n);
+        return n;
+    }
+
+    if (n > 1 && Dg_writepacket_gso(sockfd, iov, n) >= 0)
+        return n;
+
+    if (n > 1 && (errno == EIO || errno == EINVAL || errno == ENOPROTOOPT || errno == EOPNOTSUPP)) {
+        gso_enable = 0;
+        printf("[Server Child #%d]: UDP_SEGMENT send failed, send datagrams one by one.\n", pid);
+    }
+    for (i = 0; i < n; i++)
+        Dg_writepacket(sockfd, iov[i].iov_base);
+    return n;
+}
+
+/* --------------------------------------------------------------------------
+ *  Dg_serv_uring_open
+ *
+ *  Server io_uring backend start function
+ *
+ *  @param  : char  *filename
+ *  @return : int   # 0 = fail, use the default path
+ * --------------------------------------------------------------------------
+ */
+int Dg_serv_uring_open(char *filename) {
+    struct stat st;
+
+    if (!ur_init(UR_ENTRIES)) {
+        printf("[Server Child #%d]: io_uring is not available, use the default path.\n", pid);
+        return 0;
+    }
+    if ((ur_file = open(filename, O_RDONLY)) < 0 || fstat(ur_file, &st) < 0) {
+        if (ur_file >= 0)
+            close(ur_file);
+        ur_file = -1;
+        ur_exit();
+        return 0;
+    }
+    ur_size = st.st_size;
+    bzero(ur_sends, sizeof(ur_sends));
+
+    printf("[Server Child #%d]: Use io_uring for file reads and sends.\n", pid);
+    return 1;
+}
+
+/* --------------------------------------------------------------------------
+ *  Dg_serv_uring_close
+ *
+ *  Server io_uring backend stop function
+ *
+ *  @param  : void
+ *  @return : void
+ *
+ *  Wait for the sends in flight and release the ring
+ * --------------------------------------------------------------------------
+ */
+void Dg_serv_uring_close() {
+    int i, busy = 1;
+
+    if (ur_file < 0)
+        return;
+
+    while (busy) {
+        for (i = 0, busy = 0; i < UR_MAXSENDS; i++)
+            busy |= ur_sends[i].busy;
+        if (busy)
+            Dg_serv_reap(1);
+    }
+    close(ur_file);
+    ur_file = -1;
+    ur_exit();
+}
+
 /* --------------------------------------------------------------------------
  *  sig_alrm
  *
@@ -113,6 +375,28 @@ static void sig_alrm(int signo) {
     Write(pfd[1], &c, 1);
 }
 
+/* --------------------------------------------------------------------------
+ *  sig_bus
+ *
+ *  Server cached file fault handler
+ *
+ *  @param  : int   signo
+ *  @return : void
+ *
+ *  The parent maps a cached file once for all children. If the file is
+ *  truncated on disk while it is sent, reading the pages past the new end
+ *  raises SIGBUS: jump back to Dg_serv_guard, which ends the session as a
+ *  sending error. Any other SIGBUS is not ours, it kills the child.
+ * --------------------------------------------------------------------------
+ */
+static void sig_bus(int signo __attribute__((unused))) {
+    if (fcache == NULL) {
+        signal(SIGBUS, SIG_DFL);
+        return;
+    }
+    siglongjmp(fc_jmpbuf, 1);
+}
+
 /* --------------------------------------------------------------------------
  *  setAlarm
  *
@@ -184,6 +468,76 @@ int checkLocal(struct socket_info *sock_head, struct sockaddr *server, struct so
     return local;
 }
 
+/* --------------------------------------------------------------------------
+ *  Dg_serv_prefetch_open
+ *
+ *  Server read-ahead start function
+ *
+ *  @param  : int   max_winsize
+ *  @return : void
+ *
+ *  Set the read-ahead depth and tell the kernel the file is read
+ *  sequentially, which also enlarges its own read-ahead window
+ * --------------------------------------------------------------------------
+ */
+void Dg_serv_prefetch_open(int max_winsize) {
+    struct stat st;
+
+    pf_off = 0;
+    pf_depth = (off_t)pf_windows * max_winsize * DATAGRAM_DATASIZE;
+    if (pf_depth == 0)
+        return;
+
+    if (ur_file >= 0)
+        pf_size = ur_size;
+    else if (fcache)
+        pf_size = fcache->size;
+    else if (fstat(fileno(fp), &st) == 0)
+        pf_size = st.st_size;
+    else
+        pf_depth = 0;
+
+    if (ur_file >= 0)
+        posix_fadvise(ur_file, 0, 0, POSIX_FADV_SEQUENTIAL);
+    else if (fcache == NULL && pf_depth > 0)
+        posix_fadvise(fileno(fp), 0, 0, POSIX_FADV_SEQUENTIAL);
+}
+
+/* --------------------------------------------------------------------------
+ *  Dg_serv_prefetch
+ *
+ *  Server read-ahead function
+ *
+ *  @param  : void
+ *  @return : void
+ *
+ *  Ask the kernel to read the file up to pf_depth bytes beyond the
+ *  buffered offset. The hints do not wait for the disk, so a cold file is
+ *  read while the datagrams already buffered are sent and ACKed
+ * --------------------------------------------------------------------------
+ */
+void Dg_serv_prefetch() {
+    off_t   off, target;
+    long    pagesize;
+
+    if (pf_depth == 0 || pf_off >= pf_size)
+        return;
+
+    target = min(buff_off + pf_depth, pf_size);
+    // hint in chunks, except for the end of file
+    if (target - pf_off < PF_CHUNK && target < pf_size)
+        return;
+
+    if (fcache) {
+        // madvise needs a page aligned address
+        pagesize = sysconf(_SC_PAGESIZE);
+        off = pf_off & ~(off_t)(pagesize - 1);
+        madvise(fcache->addr + off, target - off, MADV_WILLNEED);
+    } else
+        posix_fadvise(ur_file >= 0 ? ur_file : fileno(fp), pf_off, target - pf_off, POSIX_FADV_WILLNEED);
+    pf_off = target;
+}
+
 /* --------------------------------------------------------------------------
  *  Dg_serv_buffer
  *
@@ -194,25 +548,64 @@ int checkLocal(struct socket_info *sock_head, struct sockaddr *server, struct so
  *  @see    : struct#sender_window
  *
  *  Buffer datagrams in the sender window buffer
+ *  With the io_uring backend queue the file reads and let them run ahead
+ *  of the window, else copy from the shared file cache mapping if there
+ *  is one, otherwise read from the file
+ *  The file beyond the buffered datagrams is prefetched by the kernel
  * --------------------------------------------------------------------------
  */
 void Dg_serv_buffer(int size) {
     int i;
     struct sender_window *swnd;
+    struct io_uring_sqe  *sqe;
 
     for (i = 0; i < size; i++) {
-         // return if EOF
-        if (feof(fp)) return;
+         // stop if EOF
+        if (buff_eof) break;
 
-        // malloc memory
-        swnd = Malloc(sizeof(struct sender_window));
-        bzero(&swnd->datagram, DATAGRAM_PAYLOAD);
+        // get a node from the slab, only the header needs to be cleared,
+        // the data is filled below and only len bytes of it are sent
+        swnd = sl_alloc(swnd_slab);
+        bzero(&swnd->datagram, DATAGRAM_HEADERSIZE);
         swnd->next = NULL;
+        swnd->pending = 0;
+        swnd->sending = 0;
+        swnd->acked = 0;
 
-        // fill the datagram
+        // fill the datagram, the client learns the private port from any
+        // datagram sent before its first ACK
         swnd->datagram.seq = ++ buff_seq;
-        swnd->datagram.len = fread(swnd->datagram.data, sizeof(char), DATAGRAM_DATASIZE, fp);
-        if (feof(fp))
+        swnd->datagram.cid = conn_id;
+        if (port_pending) {
+            swnd->datagram.flag.pot = 1;
+            swnd->datagram.ack = port_pending;
+        }
+        if (ur_file >= 0) {
+            swnd->datagram.len = min((off_t)DATAGRAM_DATASIZE, ur_size - buff_off);
+            swnd->off = buff_off;
+            if (swnd->datagram.len > 0 && (sqe = ur_sqe()) != NULL) {
+                sqe->opcode = IORING_OP_READ;
+                sqe->fd = ur_file;
+                sqe->addr = (uintptr_t)swnd->datagram.data;
+                sqe->len = swnd->datagram.len;
+                sqe->off = buff_off;
+                sqe->user_data = (uintptr_t)swnd;
+                swnd->pending = 1;
+            } else if (pread(ur_file, swnd->datagram.data, swnd->datagram.len, buff_off) != swnd->datagram.len)
+                err_sys("read error");
+            buff_off += swnd->datagram.len;
+            buff_eof = (buff_off == ur_size);
+        } else if (fcache) {
+            swnd->datagram.len = min((off_t)DATAGRAM_DATASIZE, fcache->size - buff_off);
+            memcpy(swnd->datagram.data, fcache->addr + buff_off, swnd->datagram.len);
+            buff_off += swnd->datagram.len;
+            buff_eof = (buff_off == fcache->size);
+        } else {
+            swnd->datagram.len = fread(swnd->datagram.data, sizeof(char), DATAGRAM_DATASIZE, fp);
+            buff_off += swnd->datagram.len;
+            buff_eof = feof(fp);
+        }
+        if (buff_eof)
             swnd->datagram.flag.eof = 1;
 
         // modify former tail's next
@@ -227,6 +620,150 @@ void Dg_serv_buffer(int size) {
         if (swnd_now == NULL)
             swnd_now = swnd;
     }
+
+    // start the file reads
+    if (ur_file >= 0)
+        Dg_serv_reap(0);
+
+    // read ahead of the window
+    Dg_serv_prefetch();
+}
+
+/* --------------------------------------------------------------------------
+ *  Dg_serv_migrate
+ *
+ *  Server client address change function
+ *
+ *  @param  : int       sockfd
+ *  @return : int       # 1 if the socket is connected to a new address
+ *
+ *  Single-port mode only. Read a datagram of this session routed by the
+ *  parent and reconnect the socket to the address it came from, the
+ *  following datagrams of the client are delivered to the socket again.
+ *  The routed datagram itself is dropped, the ACKs are cumulative.
+ *  The cid alone does not prove the datagram is the client's: it must
+ *  also acknowledge a datagram that was sent, between the oldest one not
+ *  ACKed and the next one to send (a request or fin of the next file
+ *  acknowledges the whole last file).
+ * --------------------------------------------------------------------------
+ */
+int Dg_serv_migrate(int sockfd) {
+    int     n;
+    uint32_t    snd_una, snd_nxt;
+    struct sp_forward       fw;
+    struct sockaddr_in      peer;
+    socklen_t               len = sizeof(peer);
+
+    if ((n = read(sp_fd, &fw, sizeof(fw))) < (int)(sizeof(fw.from) + DATAGRAM_HEADERSIZE) || fw.datagram.cid != conn_id)
+        return 0;
+    snd_una = swnd_head ? swnd_head->datagram.seq : buff_seq + 1;
+    snd_nxt = swnd_now ? swnd_now->datagram.seq : buff_seq + 1;
+    if (fw.datagram.flag.nak || fw.datagram.ack < snd_una || fw.datagram.ack > snd_nxt)
+        return 0;
+    if (getpeername(sockfd, (SA *)&peer, &len) == 0 &&
+        peer.sin_addr.s_addr == fw.from.sin_addr.s_addr && peer.sin_port == fw.from.sin_port)
+        return 0;
+
+    Connect(sockfd, (SA *)&fw.from, sizeof(fw.from));
+    printf("[Server Child #%d]: Client address changed to %s:%d.\n", pid, inet_ntoa(fw.from.sin_addr), ntohs(fw.from.sin_port));
+    return 1;
+}
+
+/* --------------------------------------------------------------------------
+ *  Dg_serv_request
+ *
+ *  Server next file request function
+ *
+ *  @param  : struct filedatagram   *datagram   # datagram with fln or fin = 1
+ *  @return : int   # 1 if it requests the next file of the session or
+ *                  # closes it
+ *
+ *  The request of the next file (or the fin) is only valid once the whole
+ *  file is buffered and it acknowledges the last datagram; save the
+ *  filename and the advertised window for Dg_serv_next
+ * --------------------------------------------------------------------------
+ */
+int Dg_serv_request(struct filedatagram *datagram) {
+    int n;
+
+    if (!buff_eof || datagram->ack != buff_seq + 1 || ka_file[0] != 0 || ka_fin)
+        return 0;
+    if (datagram->flag.fin)
+        return ka_fin = 1;
+
+    n = min(datagram->len, FILENAME_BUFFSIZE - 1);
+    memcpy(ka_file, datagram->data, n);
+    ka_file[n] = 0;
+    ka_wnd = datagram->wnd;
+    return n > 0;
+}
+
+/* --------------------------------------------------------------------------
+ *  Dg_serv_next
+ *
+ *  Server persistent session wait function
+ *
+ *  @param  : int       sockfd
+ *            char      *filename   # buffer of FILENAME_BUFFSIZE bytes
+ *  @return : int       # 1 if the next file is requested, 0 if idle or
+ *                      # closed by the client
+ *
+ *  Wait up to KA_IDLE seconds for the request of the next file or the fin
+ *  (unless it came with the last ACKs), the late ACKs of the last file are
+ *  dropped. The fin is answered with a fin, then the session ends.
+ *  A timeout of the last file fired after its last ACK is discarded.
+ * --------------------------------------------------------------------------
+ */
+int Dg_serv_next(int sockfd, char *filename) {
+    int     r, flag;
+    char    c;
+    fd_set  fds;
+    struct timeval      tv;
+    struct filedatagram FD;
+
+    tv.tv_sec = KA_IDLE;
+    tv.tv_usec = 0;
+    while (ka_file[0] == 0 && !ka_fin) {
+        FD_ZERO(&fds);
+        FD_SET(sockfd, &fds);
+        if (sp_fd >= 0)
+            FD_SET(sp_fd, &fds);
+
+        // select() of Linux leaves the time not slept in tv
+        r = select(max(sockfd, sp_fd) + 1, &fds, NULL, NULL, &tv);
+        if (r == -1 && errno == EINTR)
+            continue;
+        if (r == -1)
+            err_sys("select error");
+        if (r == 0)
+            return 0;
+        if (FD_ISSET(sockfd, &fds)) {
+            if (Dg_serv_read(sockfd, &FD) >= 0 && FD.cid == conn_id && (FD.flag.fln || FD.flag.fin))
+                Dg_serv_request(&FD);
+        } else if (sp_fd >= 0 && FD_ISSET(sp_fd, &fds))
+            Dg_serv_migrate(sockfd);
+    }
+
+    // the client has seen the whole file and leaves
+    if (ka_fin) {
+        bzero(&FD, DATAGRAM_HEADERSIZE);
+        FD.ack = buff_seq + 1;
+        FD.cid = conn_id;
+        FD.flag.fin = 1;
+        Dg_serv_write(sockfd, &FD);
+        printf("[Server Child #%d]: Received FIN, send FIN-ACK.\n", pid);
+        return 0;
+    }
+
+    flag = Fcntl(pfd[0], F_GETFL, 0);
+    Fcntl(pfd[0], F_SETFL, flag | FNDELAY);
+    while (read(pfd[0], &c, 1) > 0)
+        ;
+    Fcntl(pfd[0], F_SETFL, flag);
+
+    strcpy(filename, ka_file);
+    ka_file[0] = 0;
+    return 1;
 }
 
 /* --------------------------------------------------------------------------
@@ -246,6 +783,8 @@ uint32_t Dg_serv_ack(int sockfd) {
     int flag, k = 0;
     uint8_t     fr_flag = 0; // fast restransmission flag
     uint32_t    max_ack = 0; // max ack number
+    uint32_t    rtt, rto, now;
+    uint16_t    tflag, dup;
     struct sender_window *swnd;
     struct filedatagram FD;
 
@@ -254,27 +793,80 @@ uint32_t Dg_serv_ack(int sockfd) {
     Fcntl(sockfd, F_SETFL, flag | FNDELAY);
 
     while ((flag = Dg_serv_read_nb(sockfd, &FD)) >= 0) {
+        // a datagram of another session
+        if (FD.cid != conn_id)
+            continue;
+        // a file request: the next file of the session (or the fin)
+        // acknowledges the whole file, a resent one is ignored
+        if (FD.flag.fln || FD.flag.fin) {
+            if (!Dg_serv_request(&FD))
+                continue;
+            FD.ts = 0;
+        }
+        // the last ACK of the file is already handled, or an older ACK
+        // arrives after a later one
+        if (swnd_head == NULL || FD.ack < swnd_head->datagram.seq)
+            continue;
+        if (port_pending) {
+            printf("[Server Child #%d]: Received ACK. Private connection established.\n", pid);
+            port_pending = 0;
+        }
         if (FD.ack > swnd_head->datagram.seq)
             setAlarm(0);
         max_ack = max(max_ack, FD.ack);
 
-        printf("[Server Child #%d]: Received ACK #%d, awnd = %d", pid, FD.ack, FD.wnd);
-        if (FD.flag.wnd)
-            printf(" <WNDUPD>");
-
-        if (FD.ts > 0) {
-            printf(", rtt = %d", rtt_ts(&rttinfo) - FD.ts);
-            rtt_stop(&rttinfo, rtt_ts(&rttinfo) - FD.ts);
+        rtt = rto = 0;
+        tflag = FD.flag.wnd ? TR_F_WND : 0;
+        // every ACK echoes the datagram that caused it, less the time the
+        // client held the ACK
+        now = rtt_ts(&rttinfo);
+        if (FD.ts > 0 && FD.dly != DATAGRAM_NOSAMPLE) {
+            rtt = now - FD.ts;
+            rtt = rtt > FD.dly ? rtt - FD.dly : 0;
+            rto = rttinfo.rtt_rto << 16;
+            rtt_stop(&rttinfo, rtt);
+            st_rtt(rtt);
+            rto |= rttinfo.rtt_rto & 0xFFFF;
+            tflag |= TR_F_RTT;
         }
-
+        // the first ACK of the datagram resent on timeout: if it echoes a
+        // timestamp older than the retransmission, it was sent for the
+        // original datagram and the timeout was spurious (Eifel)
+        if (rto_ts > 0 && FD.ack > rto_seq) {
+            if (FD.ts > 0 && FD.ts < rto_ts) {
+                cc_recovered(1);
+                st_xfer.spurious_rtos ++;
+            } else
+                cc_recovered(0);
+            rto_ts = 0;
+        }
+        dup = cc_dupack(FD.ack, FD.flag.wnd);
+        tr_event(TR_ACK, tflag | dup << 8, FD.ack, FD.wnd, rtt, rto);
+        st_xfer.acks ++;
+        if (dup > 0)
+            st_xfer.dup_acks ++;
+
+        cc_hystart(FD.ack, swnd_now ? swnd_now->datagram.seq : buff_seq + 1, now,
+                   (tflag & TR_F_RTT) ? (int32_t)rtt : -1, rttinfo.rtt_minrtt);
+        if (ecn_enable)
+            cc_ecn(FD.ack, swnd_now ? swnd_now->datagram.seq : buff_seq + 1, FD.ce);
         cc_ack(FD.ack, FD.wnd, FD.flag.wnd, &fr_flag);
 
+        // the first ACK after a tail loss probe, if it is a duplicate one
+        // the datagrams before the probe are lost
+        if (tlp_seq > 0) {
+            if (dup > 0)
+                cc_tailloss(&fr_flag);
+            tlp_seq = 0;
+        }
+
         if (fr_flag) {
             Dg_serv_write(sockfd, &swnd_head->datagram);
-            if (isatty(fileno(stdout)))
-                printf("[Server Child #%d]: Resend datagram #%d \x1b[43;31m(Fast Retransmission)\x1B[0;0m.\n", pid, swnd_head->datagram.seq);
-            else
-                printf("[Server Child #%d]: Resend datagram #%d (Fast Retransmission).\n", pid, swnd_head->datagram.seq);
+            tr_event(TR_RESEND_FR, 0, swnd_head->datagram.seq, 0, 0, 0);
+            st_xfer.fast_rexmt ++;
+            st_xfer.dg_resent ++;
+            st_xfer.dg_sent ++;
+            st_xfer.bytes_sent += swnd_head->datagram.len;
         }
 
         // free ACKed datagram from head
@@ -288,7 +880,11 @@ uint32_t Dg_serv_ack(int sockfd) {
             if (swnd_tail == swnd)
                 swnd_tail = NULL;
             //printf("[Server Child #%d]: Free datagram #%d, k=%d, next=%d.\n", pid, swnd->datagram.seq, k, swnd->next);
-            free(swnd);
+            // an io_uring send still reads it, Dg_serv_reap frees it
+            if (swnd->sending)
+                swnd->acked = 1;
+            else
+                sl_free(swnd_slab, swnd);
 
             // try next datagram, start from head
             swnd = swnd_head;
@@ -305,6 +901,37 @@ uint32_t Dg_serv_ack(int sockfd) {
     return max_ack;
 }
 
+/* --------------------------------------------------------------------------
+ *  Dg_serv_tlp
+ *
+ *  Server tail loss probe function
+ *
+ *  @param  : int       sockfd
+ *            uint32_t  pto     # probe timeout, in milliseconds
+ *  @return : void
+ *
+ *  Resend the highest outstanding datagram (the one before swnd_now) after
+ *  pto without any ACK. When the tail of a window is lost there are no
+ *  later datagrams to bring duplicate ACKs, the ACK of the probe either
+ *  acknowledges the tail or is a duplicate one (see cc_tailloss), so the
+ *  loss is repaired by fast retransmission instead of the RTO.
+ * --------------------------------------------------------------------------
+ */
+void Dg_serv_tlp(int sockfd, uint32_t pto) {
+    struct sender_window *swnd = swnd_head;
+
+    while (swnd->next && swnd->next != swnd_now)
+        swnd = swnd->next;
+
+    tlp_seq = swnd->datagram.seq;
+    Dg_serv_write(sockfd, &swnd->datagram);
+    tr_event(TR_RESEND_TLP, 0, tlp_seq, pto, 0, 0);
+    st_xfer.tail_probes ++;
+    st_xfer.dg_resent ++;
+    st_xfer.dg_sent ++;
+    st_xfer.bytes_sent += swnd->datagram.len;
+}
+
 /* --------------------------------------------------------------------------
  *  probeClientWindow
  *
@@ -324,18 +951,22 @@ uint16_t probeClientWindow(int sockfd) {
 
     bzero(&FD, sizeof(FD));
     FD.flag.pob = 1;    // indicate this is a probe packet
+    FD.cid = conn_id;
 
 probeagain:
     Dg_serv_write(sockfd, &FD);
     setAlarm(PERSIST_TIMER);
     printf("[Server Child #%d]: Send window probe.\n", pid);
+    st_xfer.probes ++;
 
     for ( ; ; ) {
         FD_ZERO(&fds);
         FD_SET(sockfd, &fds);
         FD_SET(pfd[0], &fds);
+        if (sp_fd >= 0)
+            FD_SET(sp_fd, &fds);
 
-        r = select(max(sockfd, pfd[0]) + 1, &fds, NULL, NULL, NULL);
+        r = select(max(max(sockfd, pfd[0]), sp_fd) + 1, &fds, NULL, NULL, NULL);
         if (r == -1 && errno == EINTR)
             continue;
         if (FD_ISSET(sockfd, &fds)) {
@@ -347,6 +978,10 @@ probeagain:
             // timeout
             Read(pfd[0], &c, 1);
             goto probeagain;
+        } else if (sp_fd >= 0 && FD_ISSET(sp_fd, &fds)) {
+            // the client address has changed, probe it again
+            if (Dg_serv_migrate(sockfd))
+                goto probeagain;
         }
         if (r == -1)
             err_sys("select error");
@@ -366,42 +1001,60 @@ probeagain:
  *  @return : int       # 0 = fail
  *
  *  1. Initialize:
- *      a. Open the requested file
+ *      a. Open the requested file (if it is not in the file cache)
  *      b. Buffer the sender window
  *      c. Init Congestion Control arguments
  *  2. Sending file contents
  *      a. Call cc_wnd, get the number of datagrams can be sent one time
  *      b. If the awnd is 0, call probeClientWindow to probe window update
  *      c. Ready to send new datagram, call rtt_newpack
- *      d. Send datagrams in order, set timer if needed
+ *      d. Send datagrams in order (in bursts if UDP_SEGMENT is supported),
+ *         set timer if needed
  *      e. Use select to monitor the socket and the pipe, resend the datagram
- *         if timeout. Exit if run out of retry number.
+ *         if timeout. Exit if run out of retry number. Send one tail loss
+ *         probe if there is no ACK for rtt_pto.
  *      f. Call Dg_serv_ack to process ACK
  *      g. If there is other datagram to send, go to step.a
  *      h. Close file and exit
  * --------------------------------------------------------------------------
  */
 int Dg_serv_file(int sockfd, char *filename, int max_winsize, int rwnd) {
-    int     r;
+    int     r, n;
     char    c;
     fd_set  fds;
     char        alarm_set       = 0; // alarm set flag
+    char        tlp_armed       = 0; // 1 if a tail loss probe may be sent
+    uint32_t    pto;
+    struct timeval  tv;
     uint16_t    max_sendsize    = 0;
-    uint32_t    min_seq, max_seq;
+    uint32_t    min_seq, max_seq, limit;
 
-    fp = Fopen(filename, "r+t");
+    buff_off = 0;
+    buff_eof = 0;
+    tlp_seq = 0;
+    rto_ts = 0;
+    if ((ur_enable == 0 || Dg_serv_uring_open(filename) == 0) && fcache == NULL)
+        fp = Fopen(filename, "r+t");
+    Dg_serv_prefetch_open(max_winsize);
 
     // fill the buffer with max_winsize
     Dg_serv_buffer(max_winsize);
 
-    // init congestion control
-    cc_init(rwnd, max_winsize);
+    // init congestion control, the next files of the session go on with
+    // the window of the last one
+    if (ka_files ++ == 0) {
+        cc_init(rwnd, max_winsize);
+        if (pc_found)
+            cc_seed(pc_seed.cwnd, pc_seed.ssthresh);
+    } else
+        cc_resume(rwnd);
 
     // start to send packet
     swnd_now = swnd_head;
 
     while (1) {
         alarm_set = 0;
+        tlp_armed = 1;
         min_seq = 0xFFFFFFFF;
         max_seq = 0;
         max_sendsize = cc_wnd();
@@ -415,22 +1068,33 @@ int Dg_serv_file(int sockfd, char *filename, int max_winsize, int rwnd) {
             rtt_newpack(&rttinfo);
 
         // can only transmit cc_wnd() datagrams from swnd_head: now.seq < head.seq + cc_wnd()
-        while (swnd_now && swnd_now->datagram.seq < swnd_head->datagram.seq + max_sendsize) {
+        limit = swnd_head->datagram.seq + max_sendsize;
+        while (swnd_now && swnd_now->datagram.seq < limit) {
             // after (possible) retransmit, if sendsize > 0, send more datagrams
-            Dg_serv_write(sockfd, &swnd_now->datagram);
+            // in bursts of consecutive datagrams
+            // wait for the file read of the datagram first
+            while (swnd_now->pending)
+                Dg_serv_reap(1);
+            n = Dg_serv_burst(sockfd, swnd_now, limit);
             min_seq = min(swnd_now->datagram.seq, min_seq);
-            max_seq = max(swnd_now->datagram.seq, max_seq);
 
             // Set alarm for the oldest datagram
             if (alarm_set == 0) {
                 setAlarm(rtt_start(&rttinfo));
                 alarm_set = 1;
             }
-            swnd_now = swnd_now->next;
+            while (n-- > 0) {
+                max_seq = max(swnd_now->datagram.seq, max_seq);
+                swnd_now = swnd_now->next;
+            }
         }
 
+        // submit the sends of this cycle at once
+        if (ur_file >= 0)
+            Dg_serv_reap(0);
+
         if (max_seq > 0)
-            printf("[Server Child #%d]: Send datagram #%d - #%d.\n", pid, min_seq, max_seq);
+            tr_event(TR_SEND, 0, min_seq, max_seq, 0, 0);
 
 selectagain:
         if (alarm_set == 0) {
@@ -442,15 +1106,29 @@ selectagain:
             FD_ZERO(&fds);
             FD_SET(sockfd, &fds);
             FD_SET(pfd[0], &fds);
+            if (sp_fd >= 0)
+                FD_SET(sp_fd, &fds);
+
+            // one tail loss probe per window, if datagrams are outstanding
+            pto = (tlp_armed && swnd_now != swnd_head) ? rtt_pto(&rttinfo) : 0;
+            tv.tv_sec = pto / 1000;
+            tv.tv_usec = (pto % 1000) * 1000;
 
-            r = select(max(sockfd, pfd[0]) + 1, &fds, NULL, NULL, NULL);
+            r = select(max(max(sockfd, pfd[0]), sp_fd) + 1, &fds, NULL, NULL, pto > 0 ? &tv : NULL);
             if (r == -1 && errno == EINTR)
                 continue;
+            if (r == 0) {
+                // no ACK for pto
+                Dg_serv_tlp(sockfd, pto);
+                tlp_armed = 0;
+                continue;
+            }
             if (FD_ISSET(sockfd, &fds)) {
                 // datagram received
                 uint32_t oldseq = swnd_head->datagram.seq;
                 if (Dg_serv_ack(sockfd) > oldseq)
                     break;
+                st_tick();
             } else if (FD_ISSET(pfd[0], &fds)) {
                 // timeout
                 Read(pfd[0], &c, 1);
@@ -460,17 +1138,28 @@ selectagain:
                     else
                         printf("[Server Child #%d]: Terminate for file datagram timeout.\n", pid);
                     rttinit = 0;
+                    Dg_serv_uring_close();
                     errno = ETIMEDOUT;
                     return 0;
                 }
                 cc_timeout();
+                tlp_armed = 0;
+                tlp_seq = 0;
                 Dg_serv_write(sockfd, &swnd_head->datagram);
+                if (rto_ts == 0) {
+                    rto_seq = swnd_head->datagram.seq;
+                    rto_ts = swnd_head->datagram.ts;
+                }
                 setAlarm(rtt_start(&rttinfo));
-                if (isatty(fileno(stdout)))
-                    printf("[Server Child #%d]: Resend datagram #%d \x1b[43;31m(Timeout #%2d)\x1B[0;0m.\n", pid, swnd_head->datagram.seq, rttinfo.rtt_nrexmt);
-                else
-                    printf("[Server Child #%d]: Resend datagram #%d (Timeout #%2d).\n", pid, swnd_head->datagram.seq, rttinfo.rtt_nrexmt);
+                tr_event(TR_RESEND_TO, 0, swnd_head->datagram.seq, rttinfo.rtt_nrexmt, 0, 0);
+                st_xfer.timeouts ++;
+                st_xfer.dg_resent ++;
+                st_xfer.dg_sent ++;
+                st_xfer.bytes_sent += swnd_head->datagram.len;
                 goto selectagain;
+            } else if (sp_fd >= 0 && FD_ISSET(sp_fd, &fds)) {
+                // the client address has changed
+                Dg_serv_migrate(sockfd);
             }
             if (r == -1)
                 err_sys("select error");
@@ -478,104 +1167,95 @@ selectagain:
         // check if there is some data need to send
         if (swnd_head == NULL)
             break;
+        st_tick();
 
     }
-    Fclose(fp);
+    Dg_serv_uring_close();
+    if (fp) {
+        Fclose(fp);
+        fp = NULL;
+    }
     return 1;
 }
 
 /* --------------------------------------------------------------------------
- *  Dg_serv_port
+ *  Dg_serv_path
  *
- *  Server port number send function
+ *  Server path metrics update function
  *
- *  @param  : int               port
- *            int               listeningsockfd # old socket
- *            int               sockfd          # new private port socket
- *            struct sockaddr   *client
- *  @return : int               # -1 = fail
+ *  @param  : in_addr_t address # client IP address
+ *  @return : void
  *
- *  Use RTO mechanism to send port number
- *  If timeout, retry by sending port number to both listeningsockfd and
- *  sockfd
+ *  Save the RTT estimators and the congestion state after every file, so
+ *  a new session to the client network is seeded while this one is idle
  * --------------------------------------------------------------------------
  */
-int Dg_serv_port(int port, int listeningsockfd, int sockfd, struct sockaddr *client) {
-    char    c, s_port[10], port_retry = 0;
-    int     r;
-    fd_set  fds;
-    struct filedatagram portFD, FD;
-
-    printf("[Server Child #%d]: Waiting for port number acknowledged from client...\n", pid);
-
-    rtt_newpack(&rttinfo); // new packet
-
-    // create a datagram packet with port number
-    bzero(&portFD, sizeof(portFD));
-    portFD.seq = 0;         // port datagram has seq = 0
-    portFD.ack = 1;
-    portFD.flag.pot = 1;    // indicate this is a packet with port number
-    sprintf(s_port, "%d", port);
-    portFD.len = strlen(s_port);
-    strcpy(portFD.data, s_port);
-
-sendportagain:
-    // send the new private port number via listening socket (and connected socket, if timeout)
-    Dg_serv_send(listeningsockfd, client, sizeof(*client), &portFD);
-    if (port_retry > 0) {
-        Dg_serv_write(sockfd, &portFD);
-        if (isatty(fileno(stdout)))
-            printf("[Server Child #%d]: Resend port number %s \x1b[42;30m(Timeout #%2d)\x1B[0;0m.\n", pid, portFD.data, port_retry);
-        else
-            printf("[Server Child #%d]: Resend port number %s (Timeout #%2d).\n", pid, portFD.data, port_retry);
-    }
-    port_retry++;
-    setAlarm(rtt_start(&rttinfo));
+void Dg_serv_path(in_addr_t address) {
+    struct path_metrics pm;
 
-    for ( ; ; ) {
+    if (rttinfo.rtt_srtt == 0)
+        return;
 
-        FD_ZERO(&fds);
-        FD_SET(sockfd, &fds);
-        FD_SET(pfd[0], &fds);
+    bzero(&pm, sizeof(pm));
+    pm.srtt = rttinfo.rtt_srtt;
+    pm.rttvar = rttinfo.rtt_rttvar;
+    cc_state(&pm.cwnd, &pm.ssthresh);
+    pc_update(address, &pm);
+}
 
-        r = select(max(sockfd, pfd[0]) + 1, &fds, NULL, NULL, NULL);
+/* --------------------------------------------------------------------------
+ *  Dg_serv_session
+ *
+ *  Server session function
+ *
+ *  @param  : int       sockfd
+ *            char      *filename   # first file of the session
+ *            int       max_winsize
+ *            int       rwnd        # advertised window of the request
+ *            in_addr_t caddr       # client IP address
+ *  @return : int   # 1 if all files are sent, 0 = fail
+ *
+ *  Send the first file, then the next files the client requests on the
+ *  same socket until the session is closed or idle
+ * --------------------------------------------------------------------------
+ */
+int Dg_serv_session(int sockfd, char *filename, int max_winsize, int rwnd, in_addr_t caddr) {
+    int     r;
+    char    next[FILENAME_BUFFSIZE];
 
-        if (r == -1 && errno == EINTR)
-            continue;
-        if (FD_ISSET(sockfd, &fds)) {
-            // datagram received, should receive ACK from connection socket
-            if (Dg_serv_read(sockfd, &FD) < 0)
-                continue;
-            setAlarm(0);
-            if (FD.ts > 0)
-                rtt_stop(&rttinfo, rtt_ts(&rttinfo) - FD.ts);
-            if (FD.ack == 1 && FD.flag.pot == 1) {
-                printf("[Server Child #%d]: Received ACK. Private connection established.\n", pid);
-                close(listeningsockfd);
-                return (FD.wnd);
-            } else {
-                printf("[Server Child #%d]: Received an invalid packet (not port ACK).\n", pid);
-                goto sendportagain;
-            }
+    while ((r = Dg_serv_file(sockfd, filename, max_winsize, rwnd)) == 1) {
+        printf("[Server Child #%d]: Finish sending file \"%s\".\n", pid, filename);
+        Dg_serv_path(caddr);
+        if (Dg_serv_next(sockfd, next) == 0)
+            break;
+        printf("[Server Child #%d]: Received the next file request \"%s\" (file #%d of the session).\n", pid, next, ka_files + 1);
+        filename = next;
+        rwnd = ka_wnd;
+        fcache = NULL;  // only the first file is mapped by the parent
+    }
+    return r;
+}
 
-        } else if (FD_ISSET(pfd[0], &fds)) {
-            // timeout
-            Read(pfd[0], &c, 1);
-            if (rtt_timeout(&rttinfo) < 0) {
-                if (isatty(fileno(stdout)))
-                    printf("[Server Child #%d]: \x1b[41;33mTerminate for port datagram timeout.\x1B[0;0m\n", pid);
-                else
-                    printf("[Server Child #%d]: Terminate for port datagram timeout.\n", pid);
-                rttinit = 0;
-                errno = ETIMEDOUT;
-                break;
-            }
-            goto sendportagain;
-        }
-        if (r == -1)
-            err_sys("select error");
+/* --------------------------------------------------------------------------
+ *  Dg_serv_guard
+ *
+ *  Server cached file guard function
+ *
+ *  @param  : same as Dg_serv_session
+ *  @return : int   # 1 if all files are sent, 0 = fail
+ *
+ *  Run the session with the jump target of sig_bus. No local is changed
+ *  after sigsetjmp, the session state is in Dg_serv_session.
+ * --------------------------------------------------------------------------
+ */
+int Dg_serv_guard(int sockfd, char *filename, int max_winsize, int rwnd, in_addr_t caddr) {
+    if (sigsetjmp(fc_jmpbuf, 1) != 0) {
+        // the cached file was truncated, see sig_bus
+        printf("[Server Child #%d]: File \"%s\" changed on disk while sending.\n", pid, fcache->path);
+        fcache = NULL;
+        return 0;
     }
-    return -1;
+    return Dg_serv_session(sockfd, filename, max_winsize, rwnd, caddr);
 }
 
 /* --------------------------------------------------------------------------
@@ -583,46 +1263,94 @@ sendportagain:
  *
  *  Server service function
  *
- *  @param  : int                   listeningsockfd
+ *  @param  : int                   spfd    # socket on the well-known port,
+ *                                          # connected by the parent in
+ *                                          # single-port mode, -1 if not used
  *            struct socket_info    *sock_head
  *            struct sockaddr       *server
  *            struct sockaddr       *client
  *            char                  *filename
+ *            int                   max_winsize
+ *            int                   rwnd    # advertised window of the request
+ *            struct file_cache     *cache  # NULL if the file is not cached
+ *            uint32_t              cid     # connection ID of the session
  *  @return : void
  *
- *  Create new socket on new port number
- *  Init rtt
- *  Send private port number
+ *  Create new socket on new port number (in single-port mode, take the
+ *  socket of the parent on the well-known port, with the unix socket of
+ *  the routed datagrams)
+ *  Init rtt, seeded from the path metrics cache of the client network
+ *  Send the file at once, the data datagrams carry the private port number
+ *  until the client ACKs from it, so the setup takes one round trip
+ *  Send the next files requested on the same socket until the session is
+ *  idle for KA_IDLE seconds
  * --------------------------------------------------------------------------
  */
-void Dg_serv(int listeningsockfd, struct socket_info *sock_head, struct sockaddr *server, struct sockaddr *client, char *filename, int max_winsize) {
-    int             local = 0, sockfd, len, rwnd;
-    const int       on = 1;
+void Dg_serv(int spfd, struct socket_info *sock_head, struct sockaddr *server, struct sockaddr *client, char *filename, int max_winsize, int rwnd, struct file_cache *cache, uint32_t cid) {
+    int             local = 0, sockfd, len, r;
+    const int       on = 1, off = 0;
     struct sockaddr_in      servaddr;
     struct sockaddr_storage ss;
     struct socket_info      *sock = NULL;
+    char            peer[IP_BUFFSIZE + 8];
+    struct sockaddr_un      spaddr;
+    in_addr_t       caddr = ((struct sockaddr_in *)client)->sin_addr.s_addr;
 
     pid = getpid();
+    fcache = cache;
+    conn_id = cid;
+
+    // trace to <prefix>.<pid>
+    if (tr_prefix) {
+        char path[FILENAME_BUFFSIZE];
+        snprintf(path, sizeof(path), "%s.%d", tr_prefix, pid);
+        tr_init(path, pid);
+    } else
+        tr_init(NULL, pid);
 
-    // close all socket except 'listening' socket
+    // close all sockets, the replies come from the private port (or from
+    // a socket of the child on the well-known port)
     for (sock = sock_head; sock != NULL; sock = sock->next)
-        if (sock->sockfd != listeningsockfd) close(sock->sockfd);
+        close(sock->sockfd);
 
     // check if local
     local = checkLocal(sock_head, server, client);
 
-    // create new socket
-    sockfd = Socket(AF_INET, SOCK_DGRAM, 0);
+    // statistics exported to <dir>/udpfile_<pid>.prom
+    snprintf(peer, sizeof(peer), "%s:%d", IPclient, ntohs(((struct sockaddr_in *)client)->sin_port));
+    st_init("server", peer, filename);
+    if (st_dir) {
+        static char path[FILENAME_BUFFSIZE];
+        snprintf(path, sizeof(path), "%s/udpfile_%d.prom", st_dir, pid);
+        st_path = path;
+    }
+
+    // create new socket, or take the one of the parent
+    sockfd = spfd >= 0 ? spfd : Socket(AF_INET, SOCK_DGRAM, 0);
     if (local)
         Setsockopt(sockfd, SOL_SOCKET, SO_DONTROUTE, &on, sizeof(on));
 
-    bzero(&servaddr, sizeof(servaddr));
-    servaddr.sin_family = AF_INET;
-    //servaddr.sin_port = htons(0);
-    Inet_pton(AF_INET, IPserver, &servaddr.sin_addr);
+    // ECN capable transport, a router may mark CE instead of dropping
+    if (ecn_enable) {
+        int tos = IPTOS_ECN_ECT0;
+        if (setsockopt(sockfd, IPPROTO_IP, IP_TOS, &tos, sizeof(tos)) < 0)
+            ecn_enable = 0;
+    }
 
-    // bind the servaddr to socket
-    Bind(sockfd, (SA *)&servaddr, sizeof(servaddr));
+    // single-port mode: the socket shares the well-known port, receive the
+    // datagrams routed by the parent on the unix socket named after the cid
+    if (spfd >= 0) {
+        sp_fd = Socket(AF_LOCAL, SOCK_DGRAM, 0);
+        Bind(sp_fd, (SA *)&spaddr, Dg_sp_addr(&spaddr, ntohs(((struct sockaddr_in *)server)->sin_port), conn_id));
+    } else {
+        bzero(&servaddr, sizeof(servaddr));
+        servaddr.sin_family = AF_INET;
+        //servaddr.sin_port = htons(0);
+        Inet_pton(AF_INET, IPserver, &servaddr.sin_addr);
+
+        // bind the servaddr to socket
+        Bind(sockfd, (SA *)&servaddr, sizeof(servaddr));
+    }
 
     // getsockname of server part
     len = sizeof(ss);
@@ -634,32 +1362,67 @@ void Dg_serv(int listeningsockfd, struct socket_info *sock_head, struct sockaddr
     // output socket information
     struct sockaddr_in *sockaddr = (struct sockaddr_in *)&ss;
     if (isatty(fileno(stdout)))
-        printf("[Server Child #%d]: UDP Server Socket (with new private port): \x1B[0;33m%s:%d\x1B[0;0m\n", pid, inet_ntoa(sockaddr->sin_addr), sockaddr->sin_port);
+        printf("[Server Child #%d]: UDP Server Socket (with %s port): \x1B[0;33m%s:%d\x1B[0;0m, cid = %08x\n", pid, spfd >= 0 ? "well-known" : "new private", inet_ntoa(sockaddr->sin_addr), ntohs(sockaddr->sin_port), conn_id);
     else
-        printf("[Server Child #%d]: UDP Server Socket (with new private port): %s:%d\n", pid, inet_ntoa(sockaddr->sin_addr), sockaddr->sin_port);
+        printf("[Server Child #%d]: UDP Server Socket (with %s port): %s:%d, cid = %08x\n", pid, spfd >= 0 ? "well-known" : "new private", inet_ntoa(sockaddr->sin_addr), ntohs(sockaddr->sin_port), conn_id);
 
     // connect
-    Connect(sockfd, client, sizeof(*client));
+    if (spfd < 0)
+        Connect(sockfd, client, sizeof(*client));
+
+    // check UDP_SEGMENT is supported by the kernel, 0 = no default segment size
+    if (gso_enable && setsockopt(sockfd, SOL_UDP, UDP_SEGMENT, &off, sizeof(off)) < 0 && errno == ENOPROTOOPT) {
+        gso_enable = 0;
+        printf("[Server Child #%d]: UDP_SEGMENT is not supported, send datagrams one by one.\n", pid);
+    }
 
-    // init rtt
+    // init rtt, from the path metrics cache if an earlier session reached
+    // the client network
     if (rttinit == 0) {
         rtt_init(&rttinfo);
-        rto_display = 1;
         rttinit = 1;
     }
+    if ((pc_found = pc_lookup(caddr, &pc_seed)) == 1) {
+        rtt_seed(&rttinfo, pc_seed.srtt, pc_seed.rttvar);
+        printf("[Server Child #%d]: Path metrics cache hit. (srtt = %d, rttvar = %d, rto = %d, cwnd = %d, ssthresh = %d)\n",
+            pid, pc_seed.srtt >> 3, pc_seed.rttvar >> 2, rttinfo.rtt_rto, pc_seed.cwnd, pc_seed.ssthresh);
+    }
     Signal(SIGALRM, sig_alrm); // Signal handler
     Pipe(pfd); // create pipe
 
-    // start to transfer port number
-    if ((rwnd = Dg_serv_port(sockaddr->sin_port, listeningsockfd, sockfd, client)) >= 0) {
-        // start to transfer file content
-        if (Dg_serv_file(sockfd, filename, max_winsize, rwnd) == 1)
-            printf("[Server Child #%d]: Finish sending file.\n", pid);
-        else
-            printf("[Server Child #%d]: Sending file error.\n", pid);
-    } else
+    // sender window nodes
+    swnd_slab = sl_create(sizeof(struct sender_window), sl_hugepage);
+
+    // start to transfer file content, with the port number until the first
+    // ACK, then the next files the client requests in this session
+    port_pending = ntohs(sockaddr->sin_port);
+    Signal(SIGBUS, sig_bus);
+    r = Dg_serv_guard(sockfd, filename, max_winsize, rwnd, caddr);
+    if (r == 1 && ka_fin)
+        printf("[Server Child #%d]: Session closed by client, %d files sent.\n", pid, ka_files);
+    else if (r == 1)
+        printf("[Server Child #%d]: Session idle for %ds, %d files sent.\n", pid, KA_IDLE, ka_files);
+    else if (port_pending)
         printf("[Server Child #%d]: Sending port number error.\n", pid);
+    else
+        printf("[Server Child #%d]: Sending file error.\n", pid);
+
+    // a failed session does not seed the next one
+    if (r == 0)
+        pc_update(caddr, NULL);
+
+    printf("[Server Child #%d]: Slab: allocs = %lu, frees = %lu, peak = %u, blocks = %u (%lu bytes).\n",
+        pid, swnd_slab->allocs, swnd_slab->frees, swnd_slab->peak, swnd_slab->nblocks, swnd_slab->nblocks * swnd_slab->blocksize);
+    sl_destroy(swnd_slab);
+    swnd_slab = NULL;
+    swnd_head = swnd_now = swnd_tail = NULL;
+    tr_flush();
+    st_export(1);
 
     close(pfd[0]);
     close(pfd[1]);
+    if (sp_fd >= 0) {
+        close(sp_fd);
+        sp_fd = -1;
+    }
 }
@@ -0,0 +1,239 @@
+/*
+* @Author: Yinlong Su
+* @Date:   2015-10-31 09:12:40
+* @Last Modified by:   Yinlong Su
+* @Last Modified time: 2015-10-31 16:25:03
+*
+* File:         dgslab.c
+* Description:  Datagram Slab Allocator C file
+*/
+
+#include <sys/mman.h>
+#include "udpfile.h"
+
+uint32_t    sl_threads = 0;         // # threads that have a free list index
+__thread int sl_tid = -1;           // free list index of this thread
+
+/* --------------------------------------------------------------------------
+ *  sl_cache_get
+ *
+ *  Get the free list of this thread
+ *
+ *  @param  : struct dg_slab    *sl
+ *  @return : struct sl_cache * # NULL if there are more than SL_MAXTHREADS
+ *                              # threads, they share the global free list
+ *
+ *  # This is a static inline function
+ * --------------------------------------------------------------------------
+ */
+static inline struct sl_cache *sl_cache_get(struct dg_slab *sl) {
+    if (sl_tid < 0)
+        sl_tid = __atomic_fetch_add(&sl_threads, 1, __ATOMIC_RELAXED);
+    if (sl_tid >= SL_MAXTHREADS)
+        return NULL;
+    return &sl->cache[sl_tid];
+}
+
+/* --------------------------------------------------------------------------
+ *  sl_grow
+ *
+ *  Slab grow function
+ *
+ *  @param  : struct dg_slab    *sl
+ *  @return : int   # 0 = fail (out of memory)
+ *
+ *  Map a new block and put all its objects on the global free list
+ *  With hugepage, try a hugetlb page first, then a normal block that the
+ *  kernel may back with a transparent huge page
+ *  # sl->mutex should be held
+ * --------------------------------------------------------------------------
+ */
+static int sl_grow(struct dg_slab *sl) {
+    char    *block = MAP_FAILED;
+    size_t  i, n;
+    void    **obj;
+
+#ifdef MAP_HUGETLB
+    if (sl->hugepage)
+        block = mmap(NULL, sl->blocksize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+#endif
+    if (block == MAP_FAILED) {
+        block = mmap(NULL, sl->blocksize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (block == MAP_FAILED)
+            return 0;
+#ifdef MADV_HUGEPAGE
+        if (sl->hugepage)
+            madvise(block, sl->blocksize, MADV_HUGEPAGE);
+#endif
+    }
+
+    // the first object keeps the block list
+    *(void **)block = sl->blocks;
+    sl->blocks = block;
+    sl->nblocks ++;
+
+    n = sl->blocksize / sl->size;
+    for (i = 1; i < n; i++) {
+        obj = (void **)(block + i * sl->size);
+        *obj = sl->free;
+        sl->free = obj;
+    }
+    sl->nfree += n - 1;
+    return 1;
+}
+
+/* --------------------------------------------------------------------------
+ *  sl_create
+ *
+ *  Slab create function
+ *
+ *  @param  : size_t    size        # object size
+ *            int       hugepage    # 1 if the blocks should use huge pages
+ *  @return : struct dg_slab *
+ *  @see    : struct#dg_slab
+ *
+ *  Objects are rounded up to SL_ALIGN bytes and carved from blocks of
+ *  SL_BLOCKSIZE bytes (SL_HUGEBLOCKSIZE with hugepage). Blocks are only
+ *  released by sl_destroy, so the steady state does not call malloc/free
+ * --------------------------------------------------------------------------
+ */
+struct dg_slab *sl_create(size_t size, int hugepage) {
+    struct dg_slab  *sl;
+
+    sl = Calloc(1, sizeof(struct dg_slab));
+    sl->size = (max(size, sizeof(void *)) + SL_ALIGN - 1) & ~(size_t)(SL_ALIGN - 1);
+    sl->hugepage = hugepage;
+    sl->blocksize = hugepage ? SL_HUGEBLOCKSIZE : SL_BLOCKSIZE;
+    if (sl->blocksize < 2 * sl->size)
+        sl->blocksize = 2 * sl->size;
+    Pthread_mutex_init(&sl->mutex, NULL);
+    return sl;
+}
+
+/* --------------------------------------------------------------------------
+ *  sl_destroy
+ *
+ *  Slab destroy function
+ *
+ *  @param  : struct dg_slab    *sl
+ *  @return : void
+ *
+ *  Unmap all blocks, objects still in use become invalid
+ * --------------------------------------------------------------------------
+ */
+void sl_destroy(struct dg_slab *sl) {
+    void    *block, *next;
+
+    if (sl == NULL)
+        return;
+
+    for (block = sl->blocks; block != NULL; block = next) {
+        next = *(void **)block;
+        munmap(block, sl->blocksize);
+    }
+    pthread_mutex_destroy(&sl->mutex);
+    free(sl);
+}
+
+/* --------------------------------------------------------------------------
+ *  sl_alloc
+ *
+ *  Slab allocate function
+ *
+ *  @param  : struct dg_slab    *sl
+ *  @return : void *    # the object, its contents are undefined
+ *
+ *  Take the object from the free list of this thread. If it is empty,
+ *  refill SL_BATCH objects from the global free list, which grows by one
+ *  block when it is empty
+ * --------------------------------------------------------------------------
+ */
+void *sl_alloc(struct dg_slab *sl) {
+    struct sl_cache *c = sl_cache_get(sl);
+    void    **obj;
+    uint32_t inuse;
+
+    if (c == NULL || c->free == NULL) {
+        Pthread_mutex_lock(&sl->mutex);
+        if (sl->free == NULL && !sl_grow(sl)) {
+            Pthread_mutex_unlock(&sl->mutex);
+            err_quit("slab: out of memory");
+        }
+        if (c == NULL) {
+            obj = sl->free;
+            sl->free = *obj;
+            sl->nfree --;
+            Pthread_mutex_unlock(&sl->mutex);
+            goto sl_alloc_done;
+        }
+        // move a batch to this thread
+        while (c->count < SL_BATCH && sl->free) {
+            obj = sl->free;
+            sl->free = *obj;
+            *obj = c->free;
+            c->free = obj;
+            c->count ++;
+            sl->nfree --;
+        }
+        Pthread_mutex_unlock(&sl->mutex);
+    }
+
+    obj = c->free;
+    c->free = *obj;
+    c->count --;
+
+sl_alloc_done:
+    __atomic_fetch_add(&sl->allocs, 1, __ATOMIC_RELAXED);
+    inuse = __atomic_add_fetch(&sl->inuse, 1, __ATOMIC_RELAXED);
+    if (inuse > sl->peak)
+        sl->peak = inuse;
+    return obj;
+}
+
+/* --------------------------------------------------------------------------
+ *  sl_free
+ *
+ *  Slab free function
+ *
+ *  @param  : struct dg_slab    *sl
+ *            void              *p      # object from sl_alloc
+ *  @return : void
+ *
+ *  Put the object on the free list of this thread. When it holds
+ *  SL_CACHESIZE objects, give SL_BATCH of them back to the global free
+ *  list, so the objects freed by another thread (the client print thread)
+ *  go back to the allocating thread
+ * --------------------------------------------------------------------------
+ */
+void sl_free(struct dg_slab *sl, void *p) {
+    struct sl_cache *c = sl_cache_get(sl);
+    void    **obj = p;
+    int     i;
+
+    if (p == NULL)
+        return;
+
+    __atomic_fetch_add(&sl->frees, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_sub(&sl->inuse, 1, __ATOMIC_RELAXED);
+
+    if (c && c->count < SL_CACHESIZE) {
+        *obj = c->free;
+        c->free = obj;
+        c->count ++;
+        return;
+    }
+
+    Pthread_mutex_lock(&sl->mutex);
+    *obj = sl->free;
+    sl->free = obj;
+    sl->nfree ++;
+    for (i = 0; c && i < SL_BATCH && c->free; i++) {
+        obj = c->free;
+        c->free = *obj;
+        c->count --;
+        *obj = sl->free;
+        sl->free = obj;
+        sl->nfree ++;
+    }
+    Pthread_mutex_unlock(&sl->mutex);
+}
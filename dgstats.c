@@ -0,0 +1,311 @@
+/*
+* @Author: Yinlong Su
+* @Date:   2015-11-02 09:47:31
+* @Last Modified by:   Yinlong Su
+* @Last Modified time: 2015-11-02 18:15:12
+*
+* File:         dgstats.c
+* Description:  Datagram Transfer Statistics C file
+*/
+
+#include "udpfile.h"
+
+struct st_info st_xfer;             // statistics of this transfer
+char    *st_path = NULL;            // metrics file, NULL if not exported
+
+// upper bounds of the exported RTT histogram buckets, in milliseconds
+static const uint32_t st_buckets[] = { 1, 2, 5, 10, 20, 50, 100, 200, 500, 1000, 2000 };
+
+/* --------------------------------------------------------------------------
+ *  st_now
+ *
+ *  Monotonic clock in milliseconds
+ *
+ *  @param  : void
+ *  @return : uint64_t
+ *
+ *  # This is a static inline function
+ * --------------------------------------------------------------------------
+ */
+static inline uint64_t st_now() {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/* --------------------------------------------------------------------------
+ *  st_label
+ *
+ *  Append a label to the label string of the metrics
+ *
+ *  @param  : char          *name
+ *            const char    *value  # quotes and backslashes are escaped
+ *  @return : void
+ *
+ *  # This is a static function
+ * --------------------------------------------------------------------------
+ */
+static void st_label(char *name, const char *value) {
+    char    *p = st_xfer.labels + strlen(st_xfer.labels);
+    char    *end = st_xfer.labels + sizeof(st_xfer.labels) - 4;
+
+    if (p + strlen(name) + 3 >= end)
+        return;
+    p += sprintf(p, "%s%s=\"", p == st_xfer.labels ? "" : ",", name);
+    for ( ; *value && p < end; value++) {
+        if (*value == '"' || *value == '\\')
+            *p++ = '\\';
+        if (*value == '\n') {
+            *p++ = '\\';
+            *p++ = 'n';
+        } else
+            *p++ = *value;
+    }
+    *p++ = '"';
+    *p = 0;
+}
+
+/* --------------------------------------------------------------------------
+ *  st_init
+ *
+ *  Statistics initialization
+ *
+ *  @param  : char  *role       # "server" or "client"
+ *            char  *peer       # address:port of the other side
+ *            char  *filename
+ *  @return : void
+ *
+ *  Clear the counters and start the transfer clock
+ * --------------------------------------------------------------------------
+ */
+void st_init(char *role, char *peer, char *filename) {
+    char    pidstr[16];
+
+    bzero(&st_xfer, sizeof(st_xfer));
+    st_xfer.server = (strcmp(role, "server") == 0);
+    st_xfer.rtt_min = 0xFFFFFFFF;
+    st_xfer.series_step = 1;
+    st_xfer.start = st_xfer.last_export = st_now();
+
+    snprintf(pidstr, sizeof(pidstr), "%d", getpid());
+    st_label("role", role);
+    st_label("pid", pidstr);
+    st_label("peer", peer);
+    st_label("file", filename);
+}
+
+/* --------------------------------------------------------------------------
+ *  st_rtt
+ *
+ *  RTT sample function
+ *
+ *  @param  : uint32_t  ms      # RTT measured by rtt_stop, in milliseconds
+ *  @return : void
+ *
+ *  Samples are counted per millisecond up to ST_RTTMAX, so the percentiles
+ *  are exact at the resolution of rtt_ts
+ * --------------------------------------------------------------------------
+ */
+void st_rtt(uint32_t ms) {
+    st_xfer.rtt_hist[min(ms, ST_RTTMAX)] ++;
+    st_xfer.rtt_n ++;
+    st_xfer.rtt_sum += ms;
+    st_xfer.rtt_min = min(st_xfer.rtt_min, ms);
+    st_xfer.rtt_max = max(st_xfer.rtt_max, ms);
+}
+
+/* --------------------------------------------------------------------------
+ *  st_rtt_pct
+ *
+ *  RTT percentile function
+ *
+ *  @param  : int       pct     # 1 ~ 100
+ *  @return : uint32_t  # the RTT in milliseconds, 0 if there is no sample
+ * --------------------------------------------------------------------------
+ */
+uint32_t st_rtt_pct(int pct) {
+    uint64_t    need, n = 0;
+    uint32_t    i;
+
+    if (st_xfer.rtt_n == 0)
+        return 0;
+    need = (st_xfer.rtt_n * pct + 99) / 100;
+    for (i = 0; i < ST_RTTMAX; i++)
+        if ((n += st_xfer.rtt_hist[i]) >= need)
+            break;
+    return i;
+}
+
+/* --------------------------------------------------------------------------
+ *  st_cwnd
+ *
+ *  cwnd sample function
+ *
+ *  @param  : uint16_t  cwnd
+ *            uint16_t  ssthresh
+ *  @return : void
+ *
+ *  Keep the cwnd time series, a sample is added only when cwnd or
+ *  ssthresh changes. When the series is full every other sample is
+ *  dropped and only one of series_step changes is kept from then on
+ * --------------------------------------------------------------------------
+ */
+void st_cwnd(uint16_t cwnd, uint16_t ssthresh) {
+    uint32_t    i;
+
+    if (st_xfer.cwnd == cwnd && st_xfer.ssthresh == ssthresh && st_xfer.series_n > 0)
+        return;
+    st_xfer.cwnd = cwnd;
+    st_xfer.ssthresh = ssthresh;
+    st_xfer.cwnd_max = max(st_xfer.cwnd_max, cwnd);
+    if (st_xfer.series_skip++ % st_xfer.series_step != 0)
+        return;
+
+    if (st_xfer.series_n == ST_SERIES) {
+        for (i = 0; i < ST_SERIES / 2; i++)
+            st_xfer.series[i] = st_xfer.series[2 * i];
+        st_xfer.series_n = ST_SERIES / 2;
+        st_xfer.series_step <<= 1;
+    }
+    st_xfer.series[st_xfer.series_n].t = st_now() - st_xfer.start;
+    st_xfer.series[st_xfer.series_n].cwnd = cwnd;
+    st_xfer.series[st_xfer.series_n].ssthresh = ssthresh;
+    st_xfer.series_n ++;
+}
+
+/* --------------------------------------------------------------------------
+ *  st_metric
+ *
+ *  Print one metric in the Prometheus text format
+ *
+ *  @param  : FILE      *out
+ *            char      *name
+ *            char      *type   # "counter" or "gauge"
+ *            char      *help
+ *            double    value
+ *  @return : void
+ *
+ *  # This is a static function
+ * --------------------------------------------------------------------------
+ */
+static void st_metric(FILE *out, char *name, char *type, char *help, double value) {
+    fprintf(out, "# HELP udpfile_%s %s\n", name, help);
+    fprintf(out, "# TYPE udpfile_%s %s\n", name, type);
+    fprintf(out, "udpfile_%s{%s} %.15g\n", name, st_xfer.labels, value);
+}
+
+/* --------------------------------------------------------------------------
+ *  st_export
+ *
+ *  Statistics export function
+ *
+ *  @param  : int   done    # 1 if the transfer is finished
+ *  @return : void
+ *
+ *  Write the counters to st_path in the Prometheus text format, so the
+ *  node exporter textfile collector (or any local scraper) can read it,
+ *  and the cwnd time series to st_path.cwnd ("ms cwnd ssthresh" lines).
+ *  The files are written to a temporary name and renamed, a reader never
+ *  sees a partial file. Once the finished transfer is exported the files
+ *  are not written again
+ * --------------------------------------------------------------------------
+ */
+void st_export(int done) {
+    char        tmp[FILENAME_BUFFSIZE + 16], path[FILENAME_BUFFSIZE + 16];
+    FILE        *out;
+    uint64_t    n = 0, now = st_now();
+    double      secs;
+    uint32_t    i, b;
+
+    if (st_path == NULL || st_xfer.done)
+        return;
+    st_xfer.done = done;
+    st_xfer.last_export = now;
+    secs = (now - st_xfer.start) / 1000.0;
+
+    snprintf(tmp, sizeof(tmp), "%s.tmp", st_path);
+    if ((out = fopen(tmp, "w")) == NULL)
+        return;
+
+    st_metric(out, "done", "gauge", "1 if the transfer is finished.", done);
+    st_metric(out, "duration_seconds", "gauge", "Duration of the transfer so far.", secs);
+    if (st_xfer.server) {
+        st_metric(out, "bytes_sent_total", "counter", "File bytes sent, including retransmissions.", st_xfer.bytes_sent);
+        st_metric(out, "throughput_bytes_per_second", "gauge", "File bytes sent per second.", secs > 0 ? st_xfer.bytes_sent / secs : 0);
+        st_metric(out, "datagrams_sent_total", "counter", "Data datagrams sent, including retransmissions.", st_xfer.dg_sent);
+        st_metric(out, "datagrams_retransmitted_total", "counter", "Data datagrams sent again.", st_xfer.dg_resent);
+        st_metric(out, "fast_retransmits_total", "counter", "Fast retransmissions.", st_xfer.fast_rexmt);
+        st_metric(out, "timeouts_total", "counter", "Retransmission timeouts.", st_xfer.timeouts);
+        st_metric(out, "tail_loss_probes_total", "counter", "Tail loss probes.", st_xfer.tail_probes);
+        st_metric(out, "spurious_timeouts_total", "counter", "Timeouts undone because the original datagram arrived.", st_xfer.spurious_rtos);
+        st_metric(out, "hystart_exits_total", "counter", "Slow starts ended by HyStart before a loss.", st_xfer.hystart_exits);
+        st_metric(out, "ecn_reductions_total", "counter", "cwnd reductions for CE marks echoed by the client.", st_xfer.ecn_reductions);
+        st_metric(out, "acks_received_total", "counter", "ACKs received.", st_xfer.acks);
+        st_metric(out, "duplicate_acks_total", "counter", "Duplicate ACKs received.", st_xfer.dup_acks);
+        st_metric(out, "window_probes_total", "counter", "Window probes sent.", st_xfer.probes);
+        st_metric(out, "cwnd", "gauge", "Congestion window, in datagrams.", st_xfer.cwnd);
+        st_metric(out, "cwnd_max", "gauge", "Largest congestion window, in datagrams.", st_xfer.cwnd_max);
+        st_metric(out, "ssthresh", "gauge", "Slow start threshold, in datagrams.", st_xfer.ssthresh);
+    } else {
+        st_metric(out, "bytes_received_total", "counter", "File bytes received in order.", st_xfer.bytes_rcvd);
+        st_metric(out, "throughput_bytes_per_second", "gauge", "File bytes received per second.", secs > 0 ? st_xfer.bytes_rcvd / secs : 0);
+        st_metric(out, "datagrams_received_total", "counter", "Datagrams received.", st_xfer.dg_rcvd);
+        st_metric(out, "datagrams_dropped_total", "counter", "Datagrams discarded by the loss simulation.", st_xfer.dg_dropped);
+        st_metric(out, "datagrams_duplicate_total", "counter", "Datagrams already in the receive buffer.", st_xfer.dg_dup);
+        st_metric(out, "datagrams_out_of_order_total", "counter", "Datagrams received out of order.", st_xfer.dg_ooo);
+        st_metric(out, "datagrams_out_of_range_total", "counter", "Datagrams out of the receive window.", st_xfer.dg_outrange);
+        st_metric(out, "datagrams_ce_marked_total", "counter", "Datagrams received with a CE mark.", st_xfer.dg_ce);
+        st_metric(out, "acks_sent_total", "counter", "ACKs sent.", st_xfer.acks_sent);
+        st_metric(out, "acks_dropped_total", "counter", "ACKs discarded by the loss simulation.", st_xfer.acks_dropped);
+    }
+
+    if (st_xfer.rtt_n > 0) {
+        st_metric(out, "rtt_min_milliseconds", "gauge", "Smallest RTT sample.", st_xfer.rtt_min);
+        st_metric(out, "rtt_avg_milliseconds", "gauge", "Average RTT.", (double)st_xfer.rtt_sum / st_xfer.rtt_n);
+        st_metric(out, "rtt_p99_milliseconds", "gauge", "99th percentile RTT.", st_rtt_pct(99));
+        st_metric(out, "rtt_max_milliseconds", "gauge", "Largest RTT sample.", st_xfer.rtt_max);
+
+        fprintf(out, "# HELP udpfile_rtt_milliseconds RTT samples.\n");
+        fprintf(out, "# TYPE udpfile_rtt_milliseconds histogram\n");
+        for (i = 0, b = 0; b < sizeof(st_buckets) / sizeof(st_buckets[0]); b++) {
+            for ( ; i <= st_buckets[b]; i++)
+                n += st_xfer.rtt_hist[i];
+            fprintf(out, "udpfile_rtt_milliseconds_bucket{%s,le=\"%d\"} %lu\n", st_xfer.labels, st_buckets[b], n);
+        }
+        fprintf(out, "udpfile_rtt_milliseconds_bucket{%s,le=\"+Inf\"} %lu\n", st_xfer.labels, st_xfer.rtt_n);
+        fprintf(out, "udpfile_rtt_milliseconds_sum{%s} %lu\n", st_xfer.labels, st_xfer.rtt_sum);
+        fprintf(out, "udpfile_rtt_milliseconds_count{%s} %lu\n", st_xfer.labels, st_xfer.rtt_n);
+    }
+    fclose(out);
+    rename(tmp, st_path);
+
+    if (st_xfer.series_n == 0)
+        return;
+    snprintf(tmp, sizeof(tmp), "%s.cwnd.tmp", st_path);
+    snprintf(path, sizeof(path), "%s.cwnd", st_path);
+    if ((out = fopen(tmp, "w")) == NULL)
+        return;
+    fprintf(out, "# ms cwnd ssthresh\n");
+    for (i = 0; i < st_xfer.series_n; i++)
+        fprintf(out, "%d %d %d\n", st_xfer.series[i].t, st_xfer.series[i].cwnd, st_xfer.series[i].ssthresh);
+    fclose(out);
+    rename(tmp, path);
+}
+
+/* --------------------------------------------------------------------------
+ *  st_tick
+ *
+ *  Statistics periodic export function
+ *
+ *  @param  : void
+ *  @return : void
+ *
+ *  Export the counters if ST_INTERVAL milliseconds passed since the last
+ *  export, so a long transfer can be watched while it runs
+ * --------------------------------------------------------------------------
+ */
+void st_tick() {
+    if (st_path && st_now() - st_xfer.last_export >= ST_INTERVAL)
+        st_export(0);
+}
@@ -0,0 +1,246 @@
+/*
+* @Author: Yinlong Su
+* @Date:   2015-11-01 10:21:07
+* @Last Modified by:   Yinlong Su
+* @Last Modified time: 2015-11-01 19:02:44
+*
+* File:         dgtrace.c
+* Description:  Datagram Event Trace C file
+*/
+
+#include "udpfile.h"
+
+int         tr_level = TR_DEBUG;    // console verbosity, events above it are not printed
+int         tr_fd = -1;             // binary trace file, -1 if not traced
+uint32_t    tr_id = 0;              // id of the process (server child pid)
+char        tr_color = 0;           // 1 if stdout is a terminal
+__thread struct tr_ring *tr_ring = NULL;    // ring of this thread
+
+// event levels, indexed by event type
+static const uint8_t tr_levels[TR_NEVENTS] = {
+    [TR_SEND]           = TR_DEBUG,
+    [TR_ACK]            = TR_DEBUG,
+    [TR_RESEND_FR]      = TR_INFO,
+    [TR_RESEND_TO]      = TR_INFO,
+    [TR_CC_SS]          = TR_DEBUG,
+    [TR_CC_CA]          = TR_DEBUG,
+    [TR_CC_TIMEOUT]     = TR_INFO,
+    [TR_CC_FR_DUP]      = TR_DEBUG,
+    [TR_CC_FR_ENTER]    = TR_INFO,
+    [TR_CC_FR_EXIT]     = TR_INFO,
+    [TR_CLI_RECV]       = TR_DEBUG,
+    [TR_CLI_ACK]        = TR_DEBUG,
+    [TR_RESEND_TLP]     = TR_INFO,
+    [TR_CC_UNDO]        = TR_INFO,
+    [TR_CC_HYSTART]     = TR_INFO,
+    [TR_CC_ECN]         = TR_INFO,
+};
+
+// reasons of a client ACK, indexed by TR_TAG_*
+static const char *tr_tags[] = {
+    "in-order", "delayed", "update rwnd", "out-of-order",
+    "received window probe", "rwnd size is 0", "already-in buffer", "out-of-range"
+};
+
+/* --------------------------------------------------------------------------
+ *  tr_init
+ *
+ *  Trace initialization
+ *
+ *  @param  : char      *path   # binary trace file, NULL if not traced
+ *            uint32_t  id      # id written in every record
+ *  @return : void
+ *
+ *  The file starts with a struct tr_header, followed by the records
+ * --------------------------------------------------------------------------
+ */
+void tr_init(char *path, uint32_t id) {
+    struct tr_header hdr;
+
+    tr_id = id;
+    tr_color = isatty(fileno(stdout));
+    if (path == NULL)
+        return;
+
+    if ((tr_fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_APPEND, 0644)) < 0) {
+        err_ret("trace: can not open %s", path);
+        return;
+    }
+    bzero(&hdr, sizeof(hdr));
+    memcpy(hdr.magic, TR_MAGIC, sizeof(hdr.magic));
+    hdr.recsize = sizeof(struct tr_record);
+    hdr.id = id;
+    Write(tr_fd, &hdr, sizeof(hdr));
+}
+
+/* --------------------------------------------------------------------------
+ *  tr_flush
+ *
+ *  Trace flush function
+ *
+ *  @param  : void
+ *  @return : void
+ *
+ *  Write the records of this thread not written yet to the trace file
+ * --------------------------------------------------------------------------
+ */
+void tr_flush() {
+    struct tr_ring  *r = tr_ring;
+    uint32_t        from;
+
+    if (r == NULL || tr_fd < 0 || r->head == r->tail)
+        return;
+
+    // the records from tail to head, the ring may wrap once
+    from = r->tail % TR_RINGSIZE;
+    if (from + (r->head - r->tail) > TR_RINGSIZE) {
+        Write(tr_fd, &r->rec[from], (TR_RINGSIZE - from) * sizeof(struct tr_record));
+        Write(tr_fd, &r->rec[0], (r->head % TR_RINGSIZE) * sizeof(struct tr_record));
+    } else
+        Write(tr_fd, &r->rec[from], (r->head - r->tail) * sizeof(struct tr_record));
+    r->tail = r->head;
+}
+
+/* --------------------------------------------------------------------------
+ *  tr_event
+ *
+ *  Trace event function
+ *
+ *  @param  : uint16_t  event   # TR_* event type
+ *            uint16_t  flags   # TR_F_* event flags
+ *            uint32_t  a0 ~ a3 # event arguments, see tr_print
+ *  @return : void
+ *
+ *  Append a timestamped record to the ring of this thread, the ring is
+ *  only written by its thread so no lock is needed. When the ring is full
+ *  it is written to the trace file at once. The console is one consumer
+ *  of the record: it is printed only if its level is within tr_level
+ * --------------------------------------------------------------------------
+ */
+void tr_event(uint16_t event, uint16_t flags, uint32_t a0, uint32_t a1, uint32_t a2, uint32_t a3) {
+    struct tr_record    rec, *p = &rec;
+    struct timespec     ts;
+    int                 print = tr_levels[event] <= tr_level;
+
+    if (tr_fd < 0 && !print)
+        return;
+
+    if (tr_fd >= 0) {
+        if (tr_ring == NULL) {
+            tr_ring = Malloc(sizeof(struct tr_ring));
+            tr_ring->head = tr_ring->tail = 0;
+        }
+        // ring is full, write it out
+        if (tr_ring->head - tr_ring->tail == TR_RINGSIZE)
+            tr_flush();
+        p = &tr_ring->rec[tr_ring->head % TR_RINGSIZE];
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    p->ts = (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+    p->id = tr_id;
+    p->event = event;
+    p->flags = flags;
+    p->arg[0] = a0;
+    p->arg[1] = a1;
+    p->arg[2] = a2;
+    p->arg[3] = a3;
+
+    if (tr_fd >= 0)
+        tr_ring->head ++;
+    if (print)
+        tr_print(stdout, p, tr_color);
+}
+
+/* --------------------------------------------------------------------------
+ *  tr_print
+ *
+ *  Trace record print function
+ *
+ *  @param  : FILE                      *out
+ *            const struct tr_record    *rec
+ *            char                      color   # 1 to highlight retransmissions
+ *  @return : void
+ *
+ *  Print the record as the console line of the event
+ * --------------------------------------------------------------------------
+ */
+void tr_print(FILE *out, const struct tr_record *rec, char color) {
+    const uint32_t  *a = rec->arg;
+
+    switch (rec->event) {
+    case TR_SEND:
+        fprintf(out, "[Server Child #%d]: Send datagram #%d - #%d.\n", rec->id, a[0], a[1]);
+        break;
+    case TR_ACK:
+        fprintf(out, "[Server Child #%d]: Received ACK #%d, awnd = %d", rec->id, a[0], a[1]);
+        if (rec->flags & TR_F_WND)
+            fprintf(out, " <WNDUPD>");
+        if (rec->flags & TR_F_RTT)
+            fprintf(out, ", rtt = %d, rto = %d -> %d", a[2], a[3] >> 16, a[3] & 0xFFFF);
+        if (rec->flags >> 8)
+            fprintf(out, " <DUP%2d>", rec->flags >> 8);
+        fprintf(out, "\n");
+        break;
+    case TR_RESEND_FR:
+        if (color)
+            fprintf(out, "[Server Child #%d]: Resend datagram #%d \x1b[43;31m(Fast Retransmission)\x1B[0;0m.\n", rec->id, a[0]);
+        else
+            fprintf(out, "[Server Child #%d]: Resend datagram #%d (Fast Retransmission).\n", rec->id, a[0]);
+        break;
+    case TR_RESEND_TO:
+        if (color)
+            fprintf(out, "[Server Child #%d]: Resend datagram #%d \x1b[43;31m(Timeout #%2d)\x1B[0;0m.\n", rec->id, a[0], a[1]);
+        else
+            fprintf(out, "[Server Child #%d]: Resend datagram #%d (Timeout #%2d).\n", rec->id, a[0], a[1]);
+        break;
+    case TR_RESEND_TLP:
+        if (color)
+            fprintf(out, "[Server Child #%d]: Resend datagram #%d \x1b[43;31m(Tail Loss Probe, %d ms)\x1B[0;0m.\n", rec->id, a[0], a[1]);
+        else
+            fprintf(out, "[Server Child #%d]: Resend datagram #%d (Tail Loss Probe, %d ms).\n", rec->id, a[0], a[1]);
+        break;
+    case TR_CC_SS:
+        fprintf(out, "[Server Child #%d]: CC Slow Start, cwnd = %d, ssthresh = %d%s\n", rec->id, a[0], a[1], (rec->flags & TR_F_SPLIT) ? " <SPLIT>" : "");
+        break;
+    case TR_CC_CA:
+        fprintf(out, "[Server Child #%d]: CC Congestion Avoidance, cwnd = %d, ssthresh = %d, ca_c = %d\n", rec->id, a[0], a[1], a[2]);
+        break;
+    case TR_CC_TIMEOUT:
+        fprintf(out, "[Server Child #%d]: CC Timeout, cwnd = %d, ssthresh = %d\n", rec->id, a[0], a[1]);
+        break;
+    case TR_CC_FR_DUP:
+        fprintf(out, "[Server Child #%d]: CC Fast Recovery - Duplicate ACK received, cwnd = %d, ssthresh = %d\n", rec->id, a[0], a[1]);
+        break;
+    case TR_CC_FR_ENTER:
+        fprintf(out, "[Server Child #%d]: CC Fast Retransmit and Fast Recovery triggered, cwnd = %d, ssthresh = %d\n", rec->id, a[0], a[1]);
+        break;
+    case TR_CC_FR_EXIT:
+        fprintf(out, "[Server Child #%d]: CC Fast Recovery - New ACK received, cwnd = %d, ssthresh = %d\n", rec->id, a[0], a[1]);
+        break;
+    case TR_CC_UNDO:
+        fprintf(out, "[Server Child #%d]: CC Spurious Timeout - State restored, cwnd = %d, ssthresh = %d\n", rec->id, a[0], a[1]);
+        break;
+    case TR_CC_HYSTART:
+        if (a[1] == HY_TRAIN)
+            fprintf(out, "[Server Child #%d]: CC HyStart - ACK train of %d ms, min rtt = %d, cwnd = %d\n", rec->id, a[2], a[3], a[0]);
+        else
+            fprintf(out, "[Server Child #%d]: CC HyStart - Delay increase, rtt = %d, min rtt = %d, cwnd = %d\n", rec->id, a[2], a[3], a[0]);
+        break;
+    case TR_CC_ECN:
+        fprintf(out, "[Server Child #%d]: CC ECN - CE marks echoed (%d), cwnd = %d, ssthresh = %d\n", rec->id, a[2], a[0], a[1]);
+        break;
+    case TR_CLI_RECV:
+        fprintf(out, "[Client]: Receive datagram #%d (ts = %d, rwnd = %d)%s%s\n", a[0], a[1], a[2],
+            (rec->flags & TR_F_EOF) ? " <EOF>" : "", (rec->flags & TR_F_POB) ? " <POB>" : "");
+        break;
+    case TR_CLI_ACK:
+        fprintf(out, "[Client]: Send ACK #%d (ack = %d, ts = %d, wnd = %d)%s (%s)%s\n", a[0], a[0], a[1], a[2],
+            (rec->flags & TR_F_WND) ? " <WND>" : "", a[3] < TR_NTAGS ? tr_tags[a[3]] : "?",
+            (rec->flags & TR_F_DROP) ? " <DROPPED>" : "");
+        break;
+    default:
+        fprintf(out, "[Trace]: Unknown event %d\n", rec->event);
+        break;
+    }
+}
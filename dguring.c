@@ -0,0 +1,185 @@
+/*
+* @Author: Yinlong Su
+* @Date:   2015-10-30 10:05:22
+* @Last Modified by:   Yinlong Su
+* @Last Modified time: 2015-10-30 17:48:10
+*
+* File:         dguring.c
+* Description:  io_uring Backend C file
+*/
+
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+#include "udpfile.h"
+
+int         ur_fd = -1;         // ring file descriptor
+unsigned    ur_queued = 0;      // # sqes queued but not submitted yet
+
+unsigned    *ur_sq_head, *ur_sq_tail, *ur_sq_mask, *ur_sq_entries, *ur_sq_array;
+unsigned    *ur_cq_head, *ur_cq_tail, *ur_cq_mask;
+struct io_uring_sqe *ur_sqes;
+struct io_uring_cqe *ur_cqes;
+
+void        *ur_sq_ptr = NULL, *ur_cq_ptr = NULL;
+size_t      ur_sq_size, ur_cq_size, ur_sqes_size;
+
+/* --------------------------------------------------------------------------
+ *  ur_init
+ *
+ *  io_uring setup function
+ *
+ *  @param  : unsigned  entries     # submission queue size
+ *  @return : int       # 0 = fail (io_uring is not available)
+ *
+ *  Create the ring and map the submission queue, the completion queue and
+ *  the sqe array. No SQ polling thread is used, the kernel only reads the
+ *  submission queue in ur_submit.
+ * --------------------------------------------------------------------------
+ */
+int ur_init(unsigned entries) {
+    struct io_uring_params p;
+
+    bzero(&p, sizeof(p));
+    if ((ur_fd = syscall(__NR_io_uring_setup, entries, &p)) < 0)
+        return 0;
+
+    ur_sq_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    ur_cq_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    if (p.features & IORING_FEAT_SINGLE_MMAP)
+        ur_sq_size = ur_cq_size = max(ur_sq_size, ur_cq_size);
+
+    ur_sq_ptr = mmap(NULL, ur_sq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ur_fd, IORING_OFF_SQ_RING);
+    if (ur_sq_ptr == MAP_FAILED)
+        goto ur_init_fail;
+    if (p.features & IORING_FEAT_SINGLE_MMAP)
+        ur_cq_ptr = ur_sq_ptr;
+    else if ((ur_cq_ptr = mmap(NULL, ur_cq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ur_fd, IORING_OFF_CQ_RING)) == MAP_FAILED)
+        goto ur_init_fail;
+
+    ur_sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+    ur_sqes = mmap(NULL, ur_sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ur_fd, IORING_OFF_SQES);
+    if (ur_sqes == MAP_FAILED)
+        goto ur_init_fail;
+
+    ur_sq_head = (void *)((char *)ur_sq_ptr + p.sq_off.head);
+    ur_sq_tail = (void *)((char *)ur_sq_ptr + p.sq_off.tail);
+    ur_sq_mask = (void *)((char *)ur_sq_ptr + p.sq_off.ring_mask);
+    ur_sq_entries = (void *)((char *)ur_sq_ptr + p.sq_off.ring_entries);
+    ur_sq_array = (void *)((char *)ur_sq_ptr + p.sq_off.array);
+    ur_cq_head = (void *)((char *)ur_cq_ptr + p.cq_off.head);
+    ur_cq_tail = (void *)((char *)ur_cq_ptr + p.cq_off.tail);
+    ur_cq_mask = (void *)((char *)ur_cq_ptr + p.cq_off.ring_mask);
+    ur_cqes = (void *)((char *)ur_cq_ptr + p.cq_off.cqes);
+    ur_queued = 0;
+    return 1;
+
+ur_init_fail:
+    if (ur_sq_ptr && ur_sq_ptr != MAP_FAILED)
+        munmap(ur_sq_ptr, ur_sq_size);
+    if (ur_cq_ptr && ur_cq_ptr != MAP_FAILED && ur_cq_ptr != ur_sq_ptr)
+        munmap(ur_cq_ptr, ur_cq_size);
+    ur_sq_ptr = ur_cq_ptr = NULL;
+    close(ur_fd);
+    ur_fd = -1;
+    return 0;
+}
+
+/* --------------------------------------------------------------------------
+ *  ur_exit
+ *
+ *  io_uring release function
+ *
+ *  @param  : void
+ *  @return : void
+ * --------------------------------------------------------------------------
+ */
+void ur_exit() {
+    if (ur_fd < 0)
+        return;
+
+    munmap(ur_sqes, ur_sqes_size);
+    if (ur_cq_ptr != ur_sq_ptr)
+        munmap(ur_cq_ptr, ur_cq_size);
+    munmap(ur_sq_ptr, ur_sq_size);
+    ur_sq_ptr = ur_cq_ptr = NULL;
+    close(ur_fd);
+    ur_fd = -1;
+}
+
+/* --------------------------------------------------------------------------
+ *  ur_submit
+ *
+ *  io_uring submit function
+ *
+ *  @param  : unsigned  wait    # wait for at least wait completions
+ *  @return : int       # -1 if error, errno is set
+ *                      # otherwise, return the number of sqes submitted
+ * --------------------------------------------------------------------------
+ */
+int ur_submit(unsigned wait) {
+    int r = syscall(__NR_io_uring_enter, ur_fd, ur_queued, wait, wait ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+
+    if (r > 0)
+        ur_queued -= r;
+    return r;
+}
+
+/* --------------------------------------------------------------------------
+ *  ur_sqe
+ *
+ *  io_uring sqe get function
+ *
+ *  @param  : void
+ *  @return : struct io_uring_sqe * # NULL if the submission queue is full
+ *
+ *  Return a zeroed sqe at the tail of the submission queue, the caller
+ *  fills it before the next ur_submit. If the queue is full, the queued
+ *  sqes are submitted first.
+ * --------------------------------------------------------------------------
+ */
+struct io_uring_sqe *ur_sqe() {
+    unsigned    idx, tail = *ur_sq_tail;
+    struct io_uring_sqe *sqe;
+
+    if (tail - __atomic_load_n(ur_sq_head, __ATOMIC_ACQUIRE) >= *ur_sq_entries) {
+        ur_submit(0);
+        if (tail - __atomic_load_n(ur_sq_head, __ATOMIC_ACQUIRE) >= *ur_sq_entries)
+            return NULL;
+    }
+
+    idx = tail & *ur_sq_mask;
+    sqe = &ur_sqes[idx];
+    bzero(sqe, sizeof(*sqe));
+    ur_sq_array[idx] = idx;
+
+    // without SQ polling the kernel reads the queue only in ur_submit,
+    // so the tail can be published before the sqe is filled
+    __atomic_store_n(ur_sq_tail, tail + 1, __ATOMIC_RELEASE);
+    ur_queued ++;
+    return sqe;
+}
+
+/* --------------------------------------------------------------------------
+ *  ur_cqe
+ *
+ *  io_uring completion get function
+ *
+ *  @param  : uint64_t  *data   # user data of the completed sqe
+ *            int       *res    # result, -errno if failed
+ *  @return : int       # 0 if there is no completion
+ * --------------------------------------------------------------------------
+ */
+int ur_cqe(uint64_t *data, int *res) {
+    unsigned    head = *ur_cq_head;
+    struct io_uring_cqe *cqe;
+
+    if (head == __atomic_load_n(ur_cq_tail, __ATOMIC_ACQUIRE))
+        return 0;
+
+    cqe = &ur_cqes[head & *ur_cq_mask];
+    *data = cqe->user_data;
+    *res = cqe->res;
+    __atomic_store_n(ur_cq_head, head + 1, __ATOMIC_RELEASE);
+    return 1;
+}
@@ -10,13 +10,36 @@
 
 #include "udpfile.h"
 
+/* --------------------------------------------------------------------------
+ *  Dg_checkpacket
+ *
+ *  Datagram check function
+ *
+ *  @param  : struct filedatagram   *datagram
+ *            int                   n           # bytes received
+ *  @return : void
+ *
+ *  The datagram is received in place without zeroing it first, so clear
+ *  the header of a short datagram and limit len to the bytes received
+ * --------------------------------------------------------------------------
+ */
+void Dg_checkpacket(struct filedatagram *datagram, int n) {
+    if (n < 0)
+        return;
+    if (n < (int)DATAGRAM_HEADERSIZE) {
+        bzero((char *)datagram + n, DATAGRAM_HEADERSIZE - n);
+        datagram->len = 0;
+    } else if (datagram->len > n - DATAGRAM_HEADERSIZE)
+        datagram->len = n - DATAGRAM_HEADERSIZE;
+}
+
 /* --------------------------------------------------------------------------
  *  Dg_sendpacket
  *
  *  Datagram sendto function
  *
  *  @param  : int                       sockfd,
- *            struct sockaddr           *to,
+ *            const struct sockaddr     *to,
  *            socklen_t                 addrlen,
  *            const struct filedatagram *datagram
  *  @return : void
@@ -24,7 +47,7 @@
  *  For the unconnected socket, use sendto() to send packets
  * --------------------------------------------------------------------------
  */
-void Dg_sendpacket(int sockfd, struct sockaddr *to, socklen_t addrlen, const struct filedatagram *datagram) {
+void Dg_sendpacket(int sockfd, const struct sockaddr *to, socklen_t addrlen, const struct filedatagram *datagram) {
     int n = DATAGRAM_HEADERSIZE + datagram->len;
 
     Sendto(sockfd, (char *)datagram, n, 0, to, addrlen);
@@ -42,14 +65,12 @@ void Dg_sendpacket(int sockfd, struct sockaddr *to, socklen_t addrlen, const str
  *  @return : void
  *
  *  For the unconnected socket, use recvfrom() to fill out packet
+ *  The datagram is received directly into the packet, no copy
  * --------------------------------------------------------------------------
  */
 void Dg_recvpacket(int sockfd, struct sockaddr *from, socklen_t *addrlen, struct filedatagram *datagram) {
-    char buff[DATAGRAM_PAYLOAD];
-
-    bzero(datagram, DATAGRAM_PAYLOAD);
-    int n = Recvfrom(sockfd, buff, DATAGRAM_PAYLOAD, 0, from, addrlen);
-    memcpy(datagram, buff, n);
+    int n = Recvfrom(sockfd, datagram, DATAGRAM_PAYLOAD, 0, from, addrlen);
+    Dg_checkpacket(datagram, n);
 }
 
 /* --------------------------------------------------------------------------
@@ -71,6 +92,62 @@ void Dg_writepacket(int sockfd, const struct filedatagram *datagram) {
     Write(sockfd, (char *)datagram, n);
 }
 
+/* --------------------------------------------------------------------------
+ *  Dg_gsomsg
+ *
+ *  Datagram burst message build function (UDP_SEGMENT)
+ *
+ *  @param  : struct msghdr *msg,
+ *            struct iovec  *iov    # one datagram per iovec
+ *            int           n       # number of datagrams
+ *            char          *ctrl   # GSO_CTRLSIZE bytes control buffer
+ *  @return : void
+ *
+ *  Build the message of n consecutive datagrams, which the kernel splits
+ *  every DATAGRAM_PAYLOAD bytes
+ * --------------------------------------------------------------------------
+ */
+void Dg_gsomsg(struct msghdr *msg, struct iovec *iov, int n, char *ctrl) {
+    struct cmsghdr  *cmsg;
+
+    bzero(msg, sizeof(*msg));
+    bzero(ctrl, GSO_CTRLSIZE);
+    msg->msg_iov = iov;
+    msg->msg_iovlen = n;
+    msg->msg_control = ctrl;
+    msg->msg_controllen = GSO_CTRLSIZE;
+
+    cmsg = CMSG_FIRSTHDR(msg);
+    cmsg->cmsg_level = SOL_UDP;
+    cmsg->cmsg_type = UDP_SEGMENT;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+    *(uint16_t *)CMSG_DATA(cmsg) = DATAGRAM_PAYLOAD;
+}
+
+/* --------------------------------------------------------------------------
+ *  Dg_writepacket_gso
+ *
+ *  Datagram burst write function (UDP_SEGMENT)
+ *
+ *  @param  : int           sockfd,
+ *            struct iovec  *iov    # one datagram per iovec
+ *            int           n       # number of datagrams
+ *  @return : int   # -1 if send error, errno is set
+ *                  # otherwise, return the length of bytes sent
+ *
+ *  For the connected socket, send n consecutive datagrams with one
+ *  sendmsg(), the kernel splits them every DATAGRAM_PAYLOAD bytes
+ *  Every datagram but the last should be DATAGRAM_PAYLOAD bytes
+ * --------------------------------------------------------------------------
+ */
+int Dg_writepacket_gso(int sockfd, struct iovec *iov, int n) {
+    char    ctrl[GSO_CTRLSIZE];
+    struct msghdr   msg;
+
+    Dg_gsomsg(&msg, iov, n, ctrl);
+    return sendmsg(sockfd, &msg, 0);
+}
+
 /* --------------------------------------------------------------------------
  *  Dg_readpacket
  *
@@ -78,22 +155,21 @@ void Dg_writepacket(int sockfd, const struct filedatagram *datagram) {
  *
  *  @param  : int                   sockfd,
  *            struct filedatagram   *datagram
- *  @return : void
+ *  @return : int   # -1 if read error
+ *                  # otherwise, return the length of bytes read
  *
  *  For the connected socket, use read() to receive packets instead of
  *  recvfrom()
+ *  The datagram is read directly into the packet, no copy
  * --------------------------------------------------------------------------
  */
 int Dg_readpacket(int sockfd, struct filedatagram *datagram) {
     int n;
-    char buff[DATAGRAM_PAYLOAD];
-
-    bzero(datagram, DATAGRAM_PAYLOAD);
 
 Dg_readpacket_again:
-    n = read(sockfd, buff, DATAGRAM_PAYLOAD);
+    n = read(sockfd, datagram, DATAGRAM_PAYLOAD);
     if (n >= 0) {
-        memcpy(datagram, buff, n);
+        Dg_checkpacket(datagram, n);
         return n;
     } else if (errno == ECONNREFUSED)
         goto Dg_readpacket_again;
@@ -113,14 +189,56 @@ Dg_readpacket_again:
  *
  *  For the connected socket, use read() to receive packets instead of
  *  recvfrom()
+ *  The datagram is read directly into the packet, no copy
  * --------------------------------------------------------------------------
  */
 int Dg_readpacket_nb(int sockfd, struct filedatagram *datagram) {
-    char buff[DATAGRAM_PAYLOAD];
+    int n = read(sockfd, datagram, DATAGRAM_PAYLOAD);
 
-    bzero(datagram, DATAGRAM_PAYLOAD);
-    int n = read(sockfd, buff, DATAGRAM_PAYLOAD);
-    if (n >= 0)
-        memcpy(datagram, buff, n);
+    Dg_checkpacket(datagram, n);
     return n;
 }
+
+/* --------------------------------------------------------------------------
+ *  Dg_sp_addr
+ *
+ *  Single-port mode child address function
+ *
+ *  @param  : struct sockaddr_un    *sun
+ *            int                   port    # well-known port of the server
+ *            uint32_t              cid     # connection ID of the session
+ *  @return : socklen_t     # length of the address
+ *
+ *  Fill the abstract unix socket address (leading '\0', no file) the parent
+ *  forwards the datagrams of session cid to
+ * --------------------------------------------------------------------------
+ */
+socklen_t Dg_sp_addr(struct sockaddr_un *sun, int port, uint32_t cid) {
+    int n;
+
+    bzero(sun, sizeof(*sun));
+    sun->sun_family = AF_LOCAL;
+    n = snprintf(sun->sun_path + 1, sizeof(sun->sun_path) - 1, SP_SOCKNAME, port, cid);
+    return sizeof(sun->sun_family) + 1 + n;
+}
+
+/* --------------------------------------------------------------------------
+ *  Dg_hash
+ *
+ *  Filename hash function
+ *
+ *  @param  : const char    *s
+ *  @return : uint32_t      # FNV-1a hash of the string
+ *
+ *  Used by the request hash chains of the parent and the file cache
+ * --------------------------------------------------------------------------
+ */
+uint32_t Dg_hash(const char *s) {
+    uint32_t h = 2166136261u;
+
+    while (*s) {
+        h ^= (unsigned char)*s++;
+        h *= 16777619u;
+    }
+    return h;
+}
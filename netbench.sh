@@ -0,0 +1,98 @@
+#!/bin/sh
+#
+# File:         netbench.sh
+# Description:  Loopback benchmark through the impairment relay
+#
+# Usage: ./netbench.sh [-s "sizes"] [-w "windows"] [-t seconds] [-p] [-k] [-- relay options]
+#
+# Every file size is sent with every window size (server max_winsize and
+# client receive window) from a server on 127.0.0.1 to a client through
+# dgrelay. The relay options (see ./dgrelay -h) set the impairment, by
+# default a 20 ms RTT with 1% burst loss. One line is printed per run:
+#
+#   size window seconds goodput(KB/s) sent resent ratio ok
+#
+# seconds is the client transfer time (request to last in-order datagram),
+# sent/resent are the data datagrams of the server and ok is 1 if the
+# client received the whole file. With -p the server runs in single-port
+# mode (server -s). With -k the run directories are kept.
+
+SIZES="16384 262144 4194304"
+WINDOWS="16 64 256"
+TIMEOUT=120
+KEEP=0
+SERVER_OPTS=
+PORT=${PORT:-41000}
+DIR=$(cd "$(dirname "$0")" && pwd)
+
+while getopts "s:w:t:pkh" c; do
+    case $c in
+    s) SIZES=$OPTARG ;;
+    w) WINDOWS=$OPTARG ;;
+    t) TIMEOUT=$OPTARG ;;
+    p) SERVER_OPTS="-s" ;;
+    k) KEEP=1 ;;
+    *) sed -n '6,18p' "$0"; exit 0 ;;
+    esac
+done
+shift $((OPTIND - 1))
+RELAY=${*:-"-r 20 -g 0.005 -e 0.5 -s 1"}
+
+# metric value of a Prometheus text file
+metric() {
+    awk -v m="udpfile_$2" '$1 ~ "^" m "{" { print $2; exit }' "$1" 2>/dev/null
+}
+
+run() {
+    size=$1; win=$2
+    run=$(mktemp -d /tmp/netbench.XXXXXX)
+    cd "$run" || exit 1
+
+    head -c "$size" /dev/urandom > bench.bin
+    printf "%d\n%d\n" "$PORT" "$win" > server.in
+    printf "127.0.0.1\n%d\nbench.bin\n%d\n1\n0.0\n0\n" $((PORT + 1)) "$win" > client.in
+
+    "$DIR/server" $SERVER_OPTS -M "$run" > server.log 2>&1 &
+    spid=$!
+    "$DIR/dgrelay" $RELAY $((PORT + 1)) 127.0.0.1 "$PORT" > relay.log 2>&1 &
+    rpid=$!
+    sleep 0.3
+    "$DIR/client" -s -f -M "$run/client.prom" > client.log 2>&1 &
+    cpid=$!
+
+    # the transfer is over when the client exports it, do not wait for FIN
+    t=0
+    while [ "$(metric client.prom done)" != "1" ] && kill -0 $cpid 2>/dev/null && [ $t -lt $((TIMEOUT * 10)) ]; do
+        sleep 0.1
+        t=$((t + 1))
+    done
+    sleep 0.2
+    kill $cpid $spid $rpid 2>/dev/null
+    wait 2>/dev/null
+
+    secs=$(metric client.prom duration_seconds)
+    rcvd=$(metric client.prom bytes_received_total)
+    prom=$(ls udpfile_*.prom 2>/dev/null | head -1)
+    sent=$(metric "$prom" datagrams_sent_total)
+    resent=$(metric "$prom" datagrams_retransmitted_total)
+    ok=0
+    [ "${rcvd:-0}" = "$size" ] && ok=1
+    echo "$size $win ${secs:-0} ${sent:-0} ${resent:-0} $ok" | awk '{
+        printf "%-10d %-6d %8.3f %10.1f %8d %8d %6.4f %d\n",
+            $1, $2, $3, ($3 > 0 ? $1 / $3 / 1024 : 0), $4, $5, ($4 > 0 ? $5 / $4 : 0), $6 }'
+
+    cd "$DIR"
+    if [ $KEEP = 1 ] || [ $ok = 0 ]; then
+        echo "# kept $run" >&2
+    else
+        rm -rf "$run"
+    fi
+}
+
+echo "# relay: $RELAY${SERVER_OPTS:+, server $SERVER_OPTS}"
+echo "# size     window  seconds  goodput     sent   resent  ratio ok"
+for size in $SIZES; do
+    for win in $WINDOWS; do
+        run "$size" "$win"
+    done
+done
@@ -11,6 +11,7 @@
 #include "udpfile.h"
 
 extern pid_t pid;
+extern int tr_level;
 
 uint32_t    last_ack;   // last ACKed sequence number
 uint32_t    this_ack;   // this ACKed sequence number
@@ -25,6 +26,18 @@ uint16_t    cwnd;       // congestion window
 uint16_t    ssthresh;   // slow start threshold
 uint16_t    ca_c;       // congestion avoidance counter
 
+uint32_t    hy_end;     // HyStart: the round ends when this seq is ACKed
+uint32_t    hy_start;   // HyStart: start time of the round
+uint32_t    hy_last;    // HyStart: time of the last ACK of the train
+uint32_t    hy_rtt;     // HyStart: min RTT of the samples of this group
+uint16_t    hy_n;       // HyStart: # RTT samples of this group
+
+uint32_t    ecn_end;    // ECN: CE marks are ignored until this seq is ACKed
+uint16_t    ecn_ce;     // ECN: CE count of the last ACK
+
+uint16_t    undo_cwnd;      // cwnd before the first timeout, 0 if none
+uint16_t    undo_ssthresh;  // ssthresh before the first timeout
+
 /* --------------------------------------------------------------------------
  *  congestion_avoidance
  *
@@ -54,7 +67,7 @@ static inline void congestion_avoidance() {
         ca_c -= cwnd;
         cwnd ++;
     }
-    printf("[Server Child #%d]: CC Congestion Avoidance, cwnd = %d, ssthresh = %d, ca_c = %d\n", pid, cwnd, ssthresh, ca_c);
+    tr_event(TR_CC_CA, 0, cwnd, ssthresh, ca_c, 0);
 }
 
 /* --------------------------------------------------------------------------
@@ -84,12 +97,12 @@ static inline void slow_start() {
         last_ack += ssthresh - cwnd;
         cwnd = ssthresh;
         ca_c = 0;
-        printf("[Server Child #%d]: CC Slow Start, cwnd = %d, ssthresh = %d <SPLIT>\n", pid, cwnd, ssthresh);
+        tr_event(TR_CC_SS, TR_F_SPLIT, cwnd, ssthresh, 0, 0);
         congestion_avoidance();
     } else {
         // cwnd is still within ssthresh
         cwnd += this_ack - last_ack;
-        printf("[Server Child #%d]: CC Slow Start, cwnd = %d, ssthresh = %d\n", pid, cwnd, ssthresh);
+        tr_event(TR_CC_SS, 0, cwnd, ssthresh, 0, 0);
     }
 
 }
@@ -109,9 +122,14 @@ static inline void slow_start() {
  *      dupACKcount = 0
  *      # retransmit missing datagram (in dgserv.c)
  *      next state is slow slart
+ *  The state before the first timeout is kept for cc_recovered.
  * --------------------------------------------------------------------------
  */
 void cc_timeout() {
+    if (undo_cwnd == 0) {
+        undo_cwnd = cwnd;
+        undo_ssthresh = ssthresh;
+    }
     ssthresh = cwnd >> 1;
     if (ssthresh < 1)
         ssthresh = 1;
@@ -119,7 +137,8 @@ void cc_timeout() {
     dup_c = 0;
     ca_c = 0;
 
-    printf("[Server Child #%d]: CC Timeout, cwnd = %d, ssthresh = %d\n", pid, cwnd, ssthresh);
+    tr_event(TR_CC_TIMEOUT, 0, cwnd, ssthresh, 0, 0);
+    st_cwnd(cwnd, ssthresh);
 }
 
 /* --------------------------------------------------------------------------
@@ -145,6 +164,10 @@ void cc_init(uint16_t advertised_wnd, uint16_t max_wnd) {
     dup_c       = 0;
     fast_rec    = 0;
     ca_c        = 0;
+    undo_cwnd   = 0;
+    hy_end      = 0;
+    ecn_end     = 0;
+    ecn_ce      = 0;
 
     awnd = advertised_wnd;
     mwnd = max_wnd;
@@ -156,7 +179,73 @@ void cc_init(uint16_t advertised_wnd, uint16_t max_wnd) {
     else
         ssthresh = CC_SSTHRESH;
 
-    printf("[Server Child #%d]: CC Initialized. (awnd = %d, mwnd = %d, iwnd = %d, cwnd = %d, ssthresh = %d)\n", pid, awnd, mwnd, iwnd, cwnd, ssthresh);
+    if (tr_level >= TR_INFO)
+        printf("[Server Child #%d]: CC Initialized. (awnd = %d, mwnd = %d, iwnd = %d, cwnd = %d, ssthresh = %d)\n", pid, awnd, mwnd, iwnd, cwnd, ssthresh);
+    st_cwnd(cwnd, ssthresh);
+}
+
+/* --------------------------------------------------------------------------
+ *  cc_resume
+ *
+ *  Congestion Control resume for the next file of a session
+ *
+ *  @param  : uint16_t  advertised_wnd  # advertised window of the request
+ *  @return : void
+ *
+ *  The next file of a persistent session is sent on the same path, so cwnd
+ *  and ssthresh are kept from the last file instead of a new slow start.
+ *  Only awnd and the duplicate ACK state are reset.
+ * --------------------------------------------------------------------------
+ */
+void cc_resume(uint16_t advertised_wnd) {
+    awnd = advertised_wnd;
+    dup_c = 0;
+    fast_rec = 0;
+    undo_cwnd = 0;
+    hy_end = 0;
+    ecn_end = 0;
+
+    if (tr_level >= TR_INFO)
+        printf("[Server Child #%d]: CC Resumed. (awnd = %d, cwnd = %d, ssthresh = %d)\n", pid, awnd, cwnd, ssthresh);
+    st_cwnd(cwnd, ssthresh);
+}
+
+/* --------------------------------------------------------------------------
+ *  cc_seed
+ *
+ *  Congestion Control seed from the path metrics cache
+ *
+ *  @param  : uint16_t  seed_cwnd       # cwnd of an earlier session
+ *            uint16_t  seed_ssthresh   # ssthresh of an earlier session
+ *  @return : void
+ *
+ *  Called after cc_init, start with the window an earlier session reached
+ *  on the same path instead of iwnd. cwnd is at most awnd, so the first
+ *  burst is not larger than the client can take.
+ * --------------------------------------------------------------------------
+ */
+void cc_seed(uint16_t seed_cwnd, uint16_t seed_ssthresh) {
+    cwnd = max(min(seed_cwnd, awnd), iwnd);
+    ssthresh = max(seed_ssthresh, 1);
+
+    if (tr_level >= TR_INFO)
+        printf("[Server Child #%d]: CC Seeded from path metrics cache. (cwnd = %d, ssthresh = %d)\n", pid, cwnd, ssthresh);
+    st_cwnd(cwnd, ssthresh);
+}
+
+/* --------------------------------------------------------------------------
+ *  cc_state
+ *
+ *  Congestion Control state
+ *
+ *  @param  : uint16_t  *cur_cwnd
+ *            uint16_t  *cur_ssthresh
+ *  @return : void
+ * --------------------------------------------------------------------------
+ */
+void cc_state(uint16_t *cur_cwnd, uint16_t *cur_ssthresh) {
+    *cur_cwnd = cwnd;
+    *cur_ssthresh = ssthresh;
 }
 
 /* --------------------------------------------------------------------------
@@ -176,6 +265,24 @@ uint16_t cc_wnd() {
     return min(cwnd, awnd);
 }
 
+/* --------------------------------------------------------------------------
+ *  cc_dupack
+ *
+ *  Congestion Control duplicate ACK counter
+ *
+ *  @param  : uint32_t  seq         # ACK sequence number
+ *            uint8_t   flag        # 1 if this ACK is a window update datagram
+ *  @return : uint16_t  # the duplicate counter after this ACK
+ *
+ *  A window update is never counted as a duplicate ACK
+ * --------------------------------------------------------------------------
+ */
+uint16_t cc_dupack(uint32_t seq, uint8_t flag) {
+    if (flag == 1 || seq != last_ack)
+        return 0;
+    return dup_c + 1;
+}
+
 /* --------------------------------------------------------------------------
  *  cc_ack
  *
@@ -212,26 +319,17 @@ uint16_t cc_wnd() {
  * --------------------------------------------------------------------------
  */
 uint16_t cc_ack(uint32_t seq, uint16_t wnd, uint8_t flag, uint8_t *fr_flag) {
+    dup_c = cc_dupack(seq, flag);
     this_ack = seq;
     awnd = wnd;
     *fr_flag = 0;
-    if (this_ack == last_ack)
-        dup_c ++;
-    else
-        dup_c = 0;
-    if (flag == 1)
-        dup_c = 0;
-
-    if (dup_c > 0)
-        printf(" <DUP%2d>", dup_c);
-    printf("\n");
 
     //printf("[Server Child #%d]: CC ACK. (ACK = %d, awnd = %d, dup_c = %d, wnd=%d)\n", pid, seq, wnd, dup_c, flag);
 
     if (dup_c > 3 && fast_rec == 1) {
         // fast recovery
         cwnd += 1;
-        printf("[Server Child #%d]: CC Fast Recovery - Duplicate ACK received, cwnd = %d, ssthresh = %d\n", pid, cwnd, ssthresh);
+        tr_event(TR_CC_FR_DUP, 0, cwnd, ssthresh, 0, 0);
     } else if (dup_c == 3) {
         ssthresh = cwnd >> 1;
         if (ssthresh < 1)
@@ -240,13 +338,13 @@ uint16_t cc_ack(uint32_t seq, uint16_t wnd, uint8_t flag, uint8_t *fr_flag) {
         // fast recovery and fast retransmit flag
         fast_rec = 1;
         *fr_flag = 1;
-        printf("[Server Child #%d]: CC Fast Retransmit and Fast Recovery triggered, cwnd = %d, ssthresh = %d\n", pid, cwnd, ssthresh);
+        tr_event(TR_CC_FR_ENTER, 0, cwnd, ssthresh, 0, 0);
     } else if (dup_c == 0 && fast_rec == 1) {
         // state: congestion avoidance
         cwnd = ssthresh;
         fast_rec = 0;
         ca_c = 0;
-        printf("[Server Child #%d]: CC Fast Recovery - New ACK received, cwnd = %d, ssthresh = %d\n", pid, cwnd, ssthresh);
+        tr_event(TR_CC_FR_EXIT, 0, cwnd, ssthresh, 0, 0);
     } else if (dup_c == 0) {
         if (cwnd < ssthresh)
             slow_start();
@@ -255,7 +353,178 @@ uint16_t cc_ack(uint32_t seq, uint16_t wnd, uint8_t flag, uint8_t *fr_flag) {
     }
 
     last_ack = this_ack;
+    st_cwnd(cwnd, ssthresh);
 
     return min(cwnd, awnd);
 }
 
+
+/* --------------------------------------------------------------------------
+ *  cc_tailloss
+ *
+ *  Congestion Control tail loss function
+ *
+ *  @param  : uint8_t   *fr_flag    # fast retransmit flag (1=retransmit)
+ *  @return : void
+ *
+ *  Called for a duplicate ACK of a tail loss probe: the probe arrived but
+ *  a datagram before it did not. There are no more datagrams to bring the
+ *  third duplicate ACK, so go into fast recovery at once, as if dup_c had
+ *  reached 3. Nothing is done if the server is already in fast recovery.
+ * --------------------------------------------------------------------------
+ */
+void cc_tailloss(uint8_t *fr_flag) {
+    if (fast_rec == 1)
+        return;
+
+    ssthresh = cwnd >> 1;
+    if (ssthresh < 1)
+        ssthresh = 1;
+    dup_c = 3;
+    fast_rec = 1;
+    *fr_flag = 1;
+    tr_event(TR_CC_FR_ENTER, 0, cwnd, ssthresh, 0, 0);
+    st_cwnd(cwnd, ssthresh);
+}
+
+/* --------------------------------------------------------------------------
+ *  cc_recovered
+ *
+ *  Congestion Control timeout recovery function
+ *
+ *  @param  : uint8_t   spurious    # 1 if the original datagram has arrived
+ *  @return : void
+ *
+ *  Called for the first ACK of the datagram resent on timeout. If the ACK
+ *  proves that the original datagram was not lost (see Dg_serv_ack), the
+ *  timeout only came from a delay spike: cwnd and ssthresh before the
+ *  first timeout are restored. Otherwise the saved state is dropped.
+ * --------------------------------------------------------------------------
+ */
+void cc_recovered(uint8_t spurious) {
+    if (undo_cwnd == 0)
+        return;
+
+    if (spurious) {
+        cwnd = max(cwnd, undo_cwnd);
+        ssthresh = max(ssthresh, undo_ssthresh);
+        dup_c = 0;
+        ca_c = 0;
+        tr_event(TR_CC_UNDO, 0, cwnd, ssthresh, 0, 0);
+        st_cwnd(cwnd, ssthresh);
+    }
+    undo_cwnd = 0;
+}
+
+/* --------------------------------------------------------------------------
+ *  cc_hystart
+ *
+ *  Congestion Control HyStart function
+ *
+ *  @param  : uint32_t  seq         # ACK sequence number
+ *            uint32_t  snd_nxt     # seq of the next datagram to send
+ *            uint32_t  now         # timestamp of the ACK, in milliseconds
+ *            int32_t   rtt         # RTT sample of the ACK, -1 if none
+ *            uint32_t  min_rtt     # windowed min RTT (rtt_minrtt)
+ *  @return : void
+ *
+ *  Called for every ACK before cc_ack. slow_start grows cwnd until it
+ *  reaches ssthresh (awnd by default), which overshoots a shallow buffer
+ *  and ends in a burst of losses. In slow start with cwnd >= HY_LOWWND,
+ *  leave it (ssthresh = cwnd) before the queue overflows when:
+ *      a. the ACKs of this round came back as one train (each within
+ *         HY_ACKDELTA of the last) longer than min_rtt / 2, the window
+ *         already fills the path
+ *      b. the min of a group of HY_NSAMPLE RTT samples in this round is
+ *         at least min_rtt + min_rtt / 8 (HY_DELAYMIN ~ HY_DELAYMAX), the
+ *         queue is growing. The min of a group ignores a single delayed
+ *         ACK; the groups go on through the round, since a queue that
+ *         drains between two rounds only shows up in their later ACKs
+ * --------------------------------------------------------------------------
+ */
+void cc_hystart(uint32_t seq, uint32_t snd_nxt, uint32_t now, int32_t rtt, uint32_t min_rtt) {
+    uint32_t thresh, group = 0;
+    uint8_t  reason = 0;
+
+    if (cwnd >= ssthresh || fast_rec == 1)
+        return;
+
+    // a new round
+    if (seq >= hy_end) {
+        hy_end = snd_nxt;
+        hy_start = hy_last = now;
+        hy_rtt = 0xFFFFFFFF;
+        hy_n = 0;
+    }
+    if (cwnd < HY_LOWWND || min_rtt == 0xFFFFFFFF)
+        return;
+
+    if (min_rtt > 0 && now - hy_last <= HY_ACKDELTA) {
+        hy_last = now;
+        if (now - hy_start > min_rtt >> 1)
+            reason = HY_TRAIN;
+    }
+
+    if (reason == 0 && rtt >= 0) {
+        group = hy_rtt = min(hy_rtt, (uint32_t)rtt);
+        if (++hy_n == HY_NSAMPLE) {
+            thresh = min(max(min_rtt >> 3, HY_DELAYMIN), HY_DELAYMAX);
+            if (hy_rtt >= min_rtt + thresh)
+                reason = HY_DELAY;
+            hy_rtt = 0xFFFFFFFF;
+            hy_n = 0;
+        }
+    }
+
+    if (reason == 0)
+        return;
+
+    ssthresh = cwnd;
+    ca_c = 0;
+    tr_event(TR_CC_HYSTART, 0, cwnd, reason, reason == HY_DELAY ? group : now - hy_start, min_rtt);
+    st_xfer.hystart_exits ++;
+    st_cwnd(cwnd, ssthresh);
+}
+
+/* --------------------------------------------------------------------------
+ *  cc_ecn
+ *
+ *  Congestion Control ECN function
+ *
+ *  @param  : uint32_t  seq         # ACK sequence number
+ *            uint32_t  snd_nxt     # seq of the next datagram to send
+ *            uint16_t  ce          # CE count echoed by the ACK
+ *  @return : void
+ *
+ *  Called for every ACK before cc_ack. A router marks CE on a datagram
+ *  instead of dropping it when its queue builds up. If the echoed count
+ *  has grown, reduce the window as on the third duplicate ACK:
+ *      ssthresh = cwnd / 2
+ *      cwnd = ssthresh
+ *  but nothing is lost, so there is no retransmission and no fast
+ *  recovery. The window is reduced once per window of data (until the
+ *  datagrams sent before the reduction are ACKed), the marks of the same
+ *  queue build-up are ignored.
+ * --------------------------------------------------------------------------
+ */
+void cc_ecn(uint32_t seq, uint32_t snd_nxt, uint16_t ce) {
+    uint16_t n = ce - ecn_ce;
+
+    // no new mark, or an older ACK
+    if (n == 0 || n >= 0x8000)
+        return;
+    ecn_ce = ce;
+    if (seq < ecn_end || fast_rec == 1)
+        return;
+
+    ecn_end = snd_nxt;
+    ssthresh = cwnd >> 1;
+    if (ssthresh < 1)
+        ssthresh = 1;
+    cwnd = ssthresh;
+    ca_c = 0;
+
+    tr_event(TR_CC_ECN, 0, cwnd, ssthresh, ce, 0);
+    st_xfer.ecn_reductions ++;
+    st_cwnd(cwnd, ssthresh);
+}
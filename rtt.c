@@ -41,6 +41,9 @@ void rtt_init(struct rtt_info *ptr) {
     ptr->rtt_base = tv.tv_sec;
 
     ptr->rtt_rtt    = 0;
+    ptr->rtt_nsample = 0;
+    ptr->rtt_minrtt = 0xFFFFFFFF;
+    ptr->rtt_minstamp = 0;
     ptr->rtt_srtt   = 0;
     ptr->rtt_rttvar = 3000;
     ptr->rtt_rto = rtt_minmax(RTT_RTOCALC(ptr));
@@ -70,18 +73,31 @@ uint32_t rtt_start(struct rtt_info *ptr) {
 }
 
 void rtt_stop(struct rtt_info *ptr, uint32_t ms) {
+    uint32_t now = rtt_ts(ptr);
+    int32_t  delta; /* signed, rtt_rtt is unsigned */
+
     ptr->rtt_rtt = ms; /* measured RTT in milliseconds */
+    ptr->rtt_nsample ++;
+
+/*
+ * rtt_minrtt is the min of the samples in the last RTT_MINWIN, a sample
+ * replaces it if it is not greater or if the min has expired
+ */
+    if (ms <= ptr->rtt_minrtt || now - ptr->rtt_minstamp > RTT_MINWIN) {
+        ptr->rtt_minrtt = ms;
+        ptr->rtt_minstamp = now;
+    }
 
 /*
  * rtt_srtt is stored in a scaled-up form, at eight times its real value
  * rtt_rttvar is stored in a scaled-up form, at four times its real value
  */
-    ptr->rtt_rtt -= (ptr->rtt_srtt >> 3);
-    ptr->rtt_srtt += ptr->rtt_rtt;
-    if (ptr->rtt_rtt < 0)
-        ptr->rtt_rtt = - ptr->rtt_rtt;
-    ptr->rtt_rtt -= (ptr->rtt_rttvar >> 2);
-    ptr->rtt_rttvar += ptr->rtt_rtt;
+    delta = (int32_t)(ms - (ptr->rtt_srtt >> 3));
+    ptr->rtt_srtt += delta;
+    if (delta < 0)
+        delta = - delta;
+    delta -= (ptr->rtt_rttvar >> 2);
+    ptr->rtt_rttvar += delta;
     if (rto_display) printf(", rto = %d -> ", ptr->rtt_rto);
     ptr->rtt_rto = (ptr->rtt_srtt >> 3) + ptr->rtt_rttvar;
 
@@ -90,6 +106,32 @@ void rtt_stop(struct rtt_info *ptr, uint32_t ms) {
 
 }
 
+/*
+ * Start from the estimators of an earlier session on the same path
+ * (scaled as rtt_srtt and rtt_rttvar) instead of rttvar = 3000
+ */
+void rtt_seed(struct rtt_info *ptr, uint32_t srtt, uint32_t rttvar) {
+    ptr->rtt_srtt   = srtt;
+    ptr->rtt_rttvar = rttvar;
+    ptr->rtt_nsample = 1;
+    ptr->rtt_rto = rtt_minmax(RTT_RTOCALC(ptr));
+}
+
+/*
+ * Tail loss probe timeout: 2 * srtt, at least RTT_PTOMIN
+ * Return 0 (no probe) before the first measurement or if the probe
+ * would not fire before the RTO
+ */
+uint32_t rtt_pto(struct rtt_info *ptr) {
+    uint32_t pto = ptr->rtt_srtt >> 2;  /* rtt_srtt is 8 * srtt */
+
+    if (ptr->rtt_nsample == 0)
+        return(0);
+    if (pto < RTT_PTOMIN)
+        pto = RTT_PTOMIN;
+    return(pto < ptr->rtt_rto ? pto : 0);
+}
+
 /*
  * Return -1 if timeout times more than RTT_MAXNREXMT
  */
@@ -0,0 +1,105 @@
+/*
+* @Author: Yinlong Su
+* @Date:   2015-11-01 15:40:18
+* @Last Modified by:   Yinlong Su
+* @Last Modified time: 2015-11-01 19:02:44
+*
+* File:         trdecode.c
+* Description:  Trace Decoder C file
+*/
+
+#include "udpfile.h"
+
+/* --------------------------------------------------------------------------
+ *  usage
+ *
+ *  Print usage
+ *
+ *  @param  : void
+ *  @return : void
+ * --------------------------------------------------------------------------
+ */
+void usage() {
+    printf("Usage: trdecode [-c] file ...\n");
+    printf("Options:\n");
+    printf("  -c       only count the events of every type\n");
+    printf("  -h       display this help\n");
+
+    exit(0);
+}
+
+/* --------------------------------------------------------------------------
+ *  decode
+ *
+ *  Decode one trace file
+ *
+ *  @param  : char  *path
+ *            int   count_only  # 1 if the records are only counted
+ *  @return : int   # 0 = fail
+ *
+ *  Print every record with its time since the first record, in seconds
+ *  (negative if it was flushed after a later one)
+ * --------------------------------------------------------------------------
+ */
+int decode(char *path, int count_only) {
+    FILE        *in;
+    uint64_t    first = 0;
+    uint32_t    n = 0, counts[TR_NEVENTS];
+    struct tr_header    hdr;
+    struct tr_record    rec;
+    int         i;
+
+    if ((in = fopen(path, "rb")) == NULL) {
+        err_ret("trdecode: can not open %s", path);
+        return 0;
+    }
+    if (fread(&hdr, sizeof(hdr), 1, in) != 1 || memcmp(hdr.magic, TR_MAGIC, sizeof(hdr.magic)) != 0 || hdr.recsize != sizeof(rec)) {
+        printf("trdecode: %s is not a trace file.\n", path);
+        fclose(in);
+        return 0;
+    }
+
+    bzero(counts, sizeof(counts));
+    printf("# %s (id = %d)\n", path, hdr.id);
+    while (fread(&rec, sizeof(rec), 1, in) == 1) {
+        if (n++ == 0)
+            first = rec.ts;
+        if (rec.event < TR_NEVENTS)
+            counts[rec.event] ++;
+        if (count_only)
+            continue;
+        // the rings are per thread and flushed in batches, a record may be
+        // older than the first one
+        printf("%12.6f ", (int64_t)(rec.ts - first) / 1e9);
+        tr_print(stdout, &rec, 0);
+    }
+    fclose(in);
+
+    printf("# %d records:", n);
+    for (i = 0; i < TR_NEVENTS; i++)
+        printf(" %d", counts[i]);
+    printf("\n");
+    return 1;
+}
+
+int main(int argc, char **argv) {
+    int c, count_only = 0, r = 0;
+
+    while ((c = getopt(argc, argv, "ch?")) != -1) {
+        switch (c) {
+        case 'c':
+            count_only = 1;
+            break;
+        default:
+            usage();
+            break;
+        }
+    }
+    if (optind >= argc)
+        usage();
+
+    for ( ; optind < argc; optind++)
+        if (!decode(argv[optind], count_only))
+            r = 1;
+    return r;
+}
@@ -20,6 +20,16 @@ double  p = 0.0;
 int     mu = 0;
 int     print_seq = 1;
 int     print_file = 1;
+char    mcast_ip[IP_BUFFSIZE];
+int     mcast_port = 0;
+int     ack_every = DELAYED_ACK_SEGS;
+int     ack_delay = DELAYED_ACK_USEC;
+int     rcv_batch = RCV_BATCH;
+int     gro = 1;
+char    *trace_file = NULL;
+
+extern int tr_level;
+extern char *st_path;
 
 /* --------------------------------------------------------------------------
 *  usage
@@ -33,11 +43,19 @@ int     print_file = 1;
 */
 void usage()
 {
-    printf("Usage: client -s -f [-h]\n");
+    printf("Usage: client -s -f [-a segments] [-d usec] [-b datagrams] [-g] [-T file] [-M file] [-m group:port] [-h] [file ...]\n");
     printf("Options:\n");
+    printf("  -a       send an ACK at least every N in-order datagrams (default %d)\n", DELAYED_ACK_SEGS);
+    printf("  -d       max delay of a pending ACK in microseconds (default %d)\n", DELAYED_ACK_USEC);
+    printf("  -b       max datagrams received by one recvmmsg call (1-%d, default %d)\n", DGBUF_MAXBATCH, RCV_BATCH);
+    printf("  -g       receive datagrams one by one, do not use UDP_GRO\n");
+    printf("  -T       write a binary event trace to file\n");
+    printf("  -M       export the transfer statistics to file (Prometheus text format)\n");
+    printf("  -m       receive the file from multicast group:port\n");
     printf("  -s       disable print seq and ack informations\n");
     printf("  -f       disable print file contents\n");
     printf("  -h       display this help\n");
+    printf("  file     next files requested in the same session after the file of client.in\n");
 
     exit(0);
 }
@@ -57,10 +75,36 @@ void parseArgs(int argc, char **argv)
 {
     // parse the user command
     int c;
-    while ((c = getopt(argc, argv, "sfh?")) != -1)
+    char *colon;
+    while ((c = getopt(argc, argv, "sfa:d:b:gT:M:m:h?")) != -1)
     {
         switch (c)
         {
+        case 'a':
+            ack_every = max(atoi(optarg), 1);
+            break;
+        case 'd':
+            ack_delay = max(atoi(optarg), 1);
+            break;
+        case 'b':
+            rcv_batch = min(max(atoi(optarg), 1), DGBUF_MAXBATCH);
+            break;
+        case 'g':
+            gro = 0;
+            break;
+        case 'T':
+            trace_file = optarg;
+            break;
+        case 'M':
+            st_path = optarg;
+            break;
+        case 'm':
+            if ((colon = strchr(optarg, ':')) == NULL || colon - optarg >= IP_BUFFSIZE)
+                usage();
+            bzero(mcast_ip, IP_BUFFSIZE);
+            memcpy(mcast_ip, optarg, colon - optarg);
+            mcast_port = atoi(colon + 1);
+            break;
         case 's':
             print_seq = 0;
             break;
@@ -237,6 +281,59 @@ int designateAddr(struct ifi_info *ifihead) {
     return 0;
 }
 
+/* --------------------------------------------------------------------------
+ *  mcastClient
+ *
+ *  Multicast receiver entry
+ *
+ *  @param  : void
+ *  @return : int
+ *  @see    : function#StartDgMcastCli
+ *
+ *  Bind a socket to the multicast group and join the group on IPclient,
+ *  several receivers on the same host can share the group port
+ * --------------------------------------------------------------------------
+ */
+int mcastClient() {
+    const int   on = 1;
+    int         sockfd, ret;
+    struct sockaddr_in  groupaddr;
+    struct ip_mreq      mreq;
+
+    sockfd = Socket(AF_INET, SOCK_DGRAM, 0);
+    Setsockopt(sockfd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+
+    bzero(&groupaddr, sizeof(groupaddr));
+    groupaddr.sin_family = AF_INET;
+    groupaddr.sin_port = htons(mcast_port);
+    Inet_pton(AF_INET, mcast_ip, &groupaddr.sin_addr);
+    Bind(sockfd, (SA *)&groupaddr, sizeof(groupaddr));
+
+    mreq.imr_multiaddr = groupaddr.sin_addr;
+    Inet_pton(AF_INET, IPclient, &mreq.imr_interface);
+    Setsockopt(sockfd, IPPROTO_IP, IP_ADD_MEMBERSHIP, &mreq, sizeof(mreq));
+
+    // initial client arguments
+    dg_arg arg;
+    bzero(&arg, sizeof(arg));
+    strcpy(arg.mcastIP, mcast_ip);
+    arg.mcastPort = mcast_port;
+    strcpy(arg.filename, filename);
+    arg.rcvWin = max_winsize;
+    arg.seed = seed;
+    arg.p = p;
+    arg.u = mu;
+
+    dg_client *cli = CreateDgCli(&arg, sockfd);
+    cli->printSeq = print_seq;
+    cli->printFile = print_file;
+
+    ret = StartDgMcastCli(cli);
+
+    DestroyDgCli(cli);
+    return ret < 0 ? 1 : 0;
+}
+
 /* --------------------------------------------------------------------------
  *  main
  *
@@ -263,6 +360,10 @@ int main(int argc, char **argv) {
 
     parseArgs(argc, argv);
 
+    // seq and ack informations are trace events, -s keeps them off the console
+    tr_level = print_seq ? TR_DEBUG : TR_QUIET;
+    tr_init(trace_file, getpid());
+
     readArguments();
     ifihead = prifinfo_plus();
 
@@ -271,6 +372,9 @@ int main(int argc, char **argv) {
 
     printf("LOCAL=%d, IPserver=%s, IPclient=%s\n", local, IPserver, IPclient);
 
+    if (mcast_port > 0)
+        return mcastClient();
+
     sockfd = Socket(AF_INET, SOCK_DGRAM, 0);
     //Setsockopt(sockfd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
     if (local)
@@ -300,17 +404,9 @@ int main(int argc, char **argv) {
     struct sockaddr_in *sockaddr = (struct sockaddr_in *)&ss;
     printf("UDP Client Socket: %s:%d\n", inet_ntoa(sockaddr->sin_addr), sockaddr->sin_port);
 
-    // connect
-    Connect(sockfd, (SA *)&servaddr, sizeof(servaddr));
-
-    // getpeername of server part
-    if (getpeername(sockfd, (SA *) &ss, &len) < 0) {
-        printf("getpeername error\n");
-        return (-1);
-    }
-
-    // output peer information
-    printf("UDP Server Socket: %s:%d\n", inet_ntoa(sockaddr->sin_addr), sockaddr->sin_port);
+    // output peer information, the socket is connected to the private port
+    // of server once it is known
+    printf("UDP Server Socket: %s:%d\n", inet_ntoa(servaddr.sin_addr), port);
 
 #if 0
     Dg_cli(sockfd);
@@ -319,24 +415,35 @@ int main(int argc, char **argv) {
     dg_arg arg;
     bzero(&arg, sizeof(arg));
     strcpy(arg.srvIP, IPserver);
-    arg.srvPort = sockaddr->sin_port;
+    arg.srvPort = port;
     strcpy(arg.filename, filename);
     arg.rcvWin = max_winsize;
     arg.seed = seed;
     arg.p = p;
     arg.u = mu;
+    arg.files = argv + optind;
+    arg.nfiles = argc - optind;
 
     // create a client
     dg_client *cli = CreateDgCli(&arg, sockfd);
     cli->printSeq = print_seq;
     cli->printFile = print_file;
+    cli->ackEvery = ack_every;
+    cli->ackDelay = ack_delay;
+    cli->rcvBatch = rcv_batch;
+    cli->gro = gro;
 
     // start the client
+    char peer[IP_BUFFSIZE + 8];
+    snprintf(peer, sizeof(peer), "%s:%d", IPserver, port);
+    st_init("client", peer, filename);
     StartDgCli(cli);
 
     // destroy the client
     DestroyDgCli(cli);
 #endif
+    tr_flush();
+    st_export(1);
     exit(0);
 }
 
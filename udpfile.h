@@ -2,6 +2,8 @@
 #define __udpfile_h
 
 #include <sys/file.h>
+#include <netinet/udp.h>
+#include <netinet/ip.h>
 #include "unp.h"
 #include "unpthread.h"
 #include "unpifiplus.h"
@@ -20,6 +22,13 @@ struct socket_info {
 };
 
 // File datagram sturcture
+//      cid is the connection ID of the session, chosen by the server parent
+//      and echoed by the client in every ACK (0 before it is known)
+//      ts of an ACK echoes the datagram that caused it, dly is how long
+//      the client held the ACK after that datagram arrived (in ms), or
+//      DATAGRAM_NOSAMPLE if ts is not the timestamp of this ACK's datagram
+//      ce of an ACK is the number of CE marked datagrams the client has
+//      received in the session (mod 65536), the data datagrams are ECT(0)
 
 typedef unsigned char BITFIELD8;
 typedef struct {
@@ -28,21 +37,25 @@ typedef struct {
     BITFIELD8   pot : 1; /* port flag */
     BITFIELD8   wnd : 1; /* window update flag */
     BITFIELD8   pob : 1; /* window probe flag */
-    BITFIELD8   r05 : 1;
-    BITFIELD8   r06 : 1;
-    BITFIELD8   r07 : 1;
+    BITFIELD8   nak : 1; /* multicast negative ack flag */
+    BITFIELD8   rnd : 1; /* multicast round end flag */
+    BITFIELD8   fin : 1; /* close flag */
 } DATAGRAM_STATUS;
 
 #define DATAGRAM_PAYLOAD    512
-#define DATAGRAM_HEADERSIZE (3 * sizeof(uint32_t) + 2 * sizeof(uint16_t) + sizeof(DATAGRAM_STATUS))
+#define DATAGRAM_HEADERSIZE (4 * sizeof(uint32_t) + 4 * sizeof(uint16_t) + sizeof(DATAGRAM_STATUS))
 #define DATAGRAM_DATASIZE   (DATAGRAM_PAYLOAD - DATAGRAM_HEADERSIZE)
+#define DATAGRAM_NOSAMPLE   0xFFFF
 
 struct filedatagram {
     uint32_t    seq;
     uint32_t    ack;
     uint32_t    ts;
+    uint32_t    cid;
     uint16_t    wnd;
     uint16_t    len;
+    uint16_t    dly;
+    uint16_t    ce;
     DATAGRAM_STATUS flag;
     char            data[DATAGRAM_DATASIZE];
 };
@@ -52,47 +65,447 @@ struct filedatagram {
 struct sender_window {
     struct filedatagram     datagram;
     struct sender_window    *next;
+    uint8_t                 pending;    /* 1 if the file read is in flight */
+    uint8_t                 sending;    /* # io_uring sends in flight reading it */
+    uint8_t                 acked;      /* 1 if ACKed while sending, freed by Dg_serv_reap */
+    off_t                   off;        /* file offset of the data, for a short read */
 };
 
 // Buffer size definition
 #define IP_BUFFSIZE         20
 #define FILENAME_BUFFSIZE   255
 
+// Server file cache structure
+//      Files are mapped read-only by the parent before fork, so every child
+//      serving the same file shares the same pages
+
+#define FC_HASHSIZE     256                 // number of buckets, must be a power of 2
+#define FC_MEMCAP       (64 * 1024 * 1024)  // default memory cap, in bytes
+
+struct file_cache {
+    char        path[FILENAME_BUFFSIZE];
+    dev_t       dev;
+    ino_t       ino;
+    off_t       size;
+    time_t      mtime;
+    char        *addr;      /* mapped file contents */
+    int         refcnt;     /* # sessions using this file */
+    int         stale;      /* 1 if the file on disk has been changed */
+    struct file_cache   *hnext;     /* next in hash chain */
+    struct file_cache   *prev;      /* LRU list */
+    struct file_cache   *next;
+};
+
 // Server connected processes sturcture
+//      Every entry is linked into three hash chains: one keyed by the request
+//      (client address, client port, filename hash), one keyed by pid and
+//      one keyed by the connection ID
+
+#define PROC_HASHSIZE   1024    // number of buckets, must be a power of 2
 
 struct process_info {
-    pid_t   pid;
-    char    filename[FILENAME_BUFFSIZE];
-    char    address[IP_BUFFSIZE];
-    int     port;
-    struct process_info *next;
+    pid_t       pid;
+    char        filename[FILENAME_BUFFSIZE];
+    in_addr_t   address;    /* client IP address (network byte order) */
+    int         port;
+    uint32_t    fhash;      /* hash of filename */
+    struct file_cache   *cache; /* cached file used by the child */
+    uint32_t    cid;        /* connection ID of the session */
+    struct process_info *next;  /* next in request hash chain */
+    struct process_info *pnext; /* next in pid hash chain */
+    struct process_info *cnext; /* next in connection ID hash chain */
+};
+
+// Single-port mode
+//      With "-s" the children reply from the well-known port: the socket of
+//      a child is bound to the same address with SO_REUSEADDR and connected
+//      to its client, so the kernel delivers the datagrams of that client
+//      to the child. A datagram of a session that still reaches the
+//      listening socket (the client address has changed, e.g. NAT
+//      rebinding) is routed by the parent through the connection ID hash
+//      chain to an abstract unix socket of the child, which reconnects to
+//      the new address.
+//      The socket of the child is bound and connected by the parent before
+//      the fork, the datagrams of other clients queued on it in between are
+//      handled by the parent.
+#define SP_SOCKNAME     "udpfile.%d.%08x"   // unix socket name of a child, from port and cid
+#define SP_DRAIN        16      // max # datagrams drained from a new child socket
+
+struct sp_forward {
+    struct sockaddr_in  from;       /* client address the datagram came from */
+    struct filedatagram datagram;
+};
+
+// Path metrics cache
+//      The srtt, rttvar, ssthresh and cwnd reached by the last session to a
+//      client network (the client address masked by the prefix length of
+//      "-c") are kept in a table mapped shared by the parent. Every child
+//      seeds its RTT estimator and congestion state from the entry of its
+//      client and updates it when the session ends. An entry is used for
+//      PC_TTL seconds.
+#define PC_ENTRIES      1024    // number of entries, must be a power of 2
+#define PC_PREFIX       32      // default prefix length of the key
+#define PC_TTL          600     // lifetime of an entry, in seconds
+
+struct path_metrics {
+    in_addr_t   key;            /* client network (network byte order) */
+    uint32_t    srtt;           /* rtt_srtt of rtt_info, scaled by 8 */
+    uint32_t    rttvar;         /* rtt_rttvar of rtt_info, scaled by 4 */
+    uint16_t    ssthresh;
+    uint16_t    cwnd;
+    time_t      updated;        /* last update, 0 if the entry is unused */
+};
+
+struct path_cache {
+    pthread_mutex_t     mutex;  /* process-shared, robust */
+    struct path_metrics entry[PC_ENTRIES];
 };
 
 // Congestion Control
 #define CC_IWND     1   // default iwnd (initial window)
 #define CC_SSTHRESH -1  // default ssthresh, -1 indicate that ssthresh = awnd
 
+// HyStart slow start exit
+//      A round ends when the datagram sent at its start is ACKed. Slow
+//      start ends early (ssthresh = cwnd) if the ACKs of a round come back
+//      as a train longer than half of the min RTT, or if the min of
+//      HY_NSAMPLE samples grows over the min RTT by min / 8 (clamped)
+#define HY_LOWWND       16  // only check a cwnd of at least HY_LOWWND
+#define HY_NSAMPLE      8   // # RTT samples per group
+#define HY_ACKDELTA     2   // max spacing of ACKs in a train, in milliseconds
+#define HY_DELAYMIN     4   // min RTT increase, in milliseconds
+#define HY_DELAYMAX     16  // max RTT increase, in milliseconds
+#define HY_TRAIN        1   // exit reasons
+#define HY_DELAY        2
+
 // Persist timer
 #define PERSIST_TIMER   2000 // default timer 2000 milliseconds
 
+// Persistent session
+//      After a file is ACKed the child waits up to KA_IDLE seconds for the
+//      next filename datagram on the private socket. The sequence numbers
+//      go on from the last file and the request acknowledges all of it
+//      (ack = last seq + 1), the RTT estimator and cwnd are kept.
+//      A datagram with the fin flag (and the same ack) closes the session,
+//      it is answered by a fin datagram, from the parent if the child has
+//      already exited.
+#define KA_IDLE         10   // idle time before a session is closed, in seconds
+
+// Multicast distribution
+//      A multicast round end datagram has seq = 0, ack = the number of
+//      datagrams of the file and wnd = the round number.
+//      A NACK datagram carries pairs of uint32_t [first, last] ranges of
+//      missing sequence numbers in data.
+#define MC_TTL              1       // default multicast TTL
+#define MC_BURST_INTERVAL   10      // interval between two bursts, in milliseconds
+#define MC_NACK_WAIT        500     // time to collect NACKs after a round, in milliseconds
+#define MC_QUIET_ROUNDS     3       // finish after this many rounds without NACK
+#define MC_MAXROUNDS        64      // max # rounds
+#define MC_MAXDATAGRAMS     (1 << 22)   // max # datagrams of a file (about 2 GB)
+#define MC_NACK_RANGES      (DATAGRAM_DATASIZE / (2 * sizeof(uint32_t)))
+
+// UDP segmentation offload
+//      The sender passes a burst of consecutive datagrams to the kernel in
+//      one send, split every DATAGRAM_PAYLOAD bytes (UDP_SEGMENT), and the
+//      receiver gets them back coalesced in one receive (UDP_GRO). Only
+//      the last datagram of a burst may be shorter than DATAGRAM_PAYLOAD.
+#ifndef SOL_UDP
+#define SOL_UDP             17
+#endif
+#ifndef UDP_SEGMENT
+#define UDP_SEGMENT         103     // from linux/udp.h, missing in old libc
+#endif
+#ifndef UDP_GRO
+#define UDP_GRO             104
+#endif
+#define GSO_MAXSEGS         64      // max datagrams per send, same as the kernel GRO limit
+#define GSO_CTRLSIZE        CMSG_SPACE(sizeof(uint16_t))
+
+// io_uring backend
+//      With "-u" the file reads of the sender window and the datagram sends
+//      of Dg_serv_file are queued to an io_uring, so reads are in flight
+//      ahead of the window and a cycle of sends is submitted at once.
+//      ACKs and timeouts are still handled by select().
+#define UR_ENTRIES          256     // submission queue size
+#define UR_MAXSENDS         32      // max sends in flight
+
+struct ur_send {
+    struct msghdr   msg;
+    struct iovec    iov[GSO_MAXSEGS];
+    char            ctrl[GSO_CTRLSIZE];
+    uint8_t         busy;           /* 1 if the send is in flight */
+};
+
+// Read-ahead prefetch
+//      The sender window only buffers new datagrams after ACKs free nodes,
+//      so the file is read ahead of it with POSIX_FADV_WILLNEED (or
+//      MADV_WILLNEED for the file cache mapping). The kernel reads the
+//      pages in the background and the page cache holds at most
+//      pf_windows windows beyond the buffered offset.
+#define PF_WINDOWS          4               // default read-ahead depth, in sender windows
+#define PF_CHUNK            (64 * 1024)     // min bytes per hint, limits the system calls
+
+// Slab allocator
+//      Fixed-size objects (sender window nodes, client fifo nodes) are
+//      carved from blocks that are never returned until the slab is
+//      destroyed. Each thread has its own free list, so the steady state
+//      does not call malloc/free and takes the slab mutex only once per
+//      SL_BATCH objects.
+#define SL_ALIGN            64                  // object alignment (cache line)
+#define SL_BLOCKSIZE        (64 * 1024)         // block size
+#define SL_HUGEBLOCKSIZE    (2 * 1024 * 1024)   // block size with huge pages
+#define SL_MAXTHREADS       8                   // # threads with their own free list
+#define SL_CACHESIZE        64                  // max objects in a thread free list
+#define SL_BATCH            32                  // objects moved from/to the global free list at once
+
+struct sl_cache {
+    void        *free;              /* free list of the thread */
+    uint32_t    count;              /* # objects in the free list */
+} __attribute__((aligned(SL_ALIGN)));
+
+struct dg_slab {
+    struct sl_cache cache[SL_MAXTHREADS];
+    size_t      size;               /* object size, rounded up to SL_ALIGN */
+    size_t      blocksize;          /* block size */
+    int         hugepage;           /* 1 if the blocks use huge pages */
+    void        *blocks;            /* block list, linked by the first object */
+    void        *free;              /* global free list */
+    uint32_t    nfree;              /* # objects in the global free list */
+    uint32_t    nblocks;            /* # blocks mapped */
+    uint64_t    allocs;             /* # sl_alloc calls */
+    uint64_t    frees;              /* # sl_free calls */
+    uint32_t    inuse;              /* # objects in use */
+    uint32_t    peak;               /* max # objects in use */
+    pthread_mutex_t mutex;          /* protect blocks and the global free list */
+};
+
+// Event trace
+//      The per-datagram events (send, ACK, retransmission, cwnd change) are
+//      fixed-size binary records in a ring of the thread instead of printf.
+//      The console prints the events within the verbosity level; with a
+//      trace file the rings are written out when full and decoded offline
+//      by trdecode.
+#define TR_QUIET            0       // no event is printed
+#define TR_INFO             1       // retransmissions and congestion events
+#define TR_DEBUG            2       // every datagram and ACK (default)
+
+#define TR_SEND             0       // a0 = first seq, a1 = last seq
+#define TR_ACK              1       // a0 = ack, a1 = awnd, a2 = rtt, a3 = rto before << 16 | rto after
+#define TR_RESEND_FR        2       // a0 = seq
+#define TR_RESEND_TO        3       // a0 = seq, a1 = # timeouts
+#define TR_CC_SS            4       // a0 = cwnd, a1 = ssthresh
+#define TR_CC_CA            5       // a0 = cwnd, a1 = ssthresh, a2 = ca_c
+#define TR_CC_TIMEOUT       6       // a0 = cwnd, a1 = ssthresh
+#define TR_CC_FR_DUP        7       // a0 = cwnd, a1 = ssthresh
+#define TR_CC_FR_ENTER      8       // a0 = cwnd, a1 = ssthresh
+#define TR_CC_FR_EXIT       9       // a0 = cwnd, a1 = ssthresh
+#define TR_CLI_RECV         10      // a0 = seq, a1 = ts, a2 = rwnd
+#define TR_CLI_ACK          11      // a0 = ack, a1 = ts, a2 = wnd, a3 = TR_TAG_*
+#define TR_RESEND_TLP       12      // a0 = seq, a1 = probe timeout
+#define TR_CC_UNDO          13      // a0 = cwnd, a1 = ssthresh
+#define TR_CC_HYSTART       14      // a0 = cwnd, a1 = HY_*, a2 = rtt, a3 = min RTT
+#define TR_CC_ECN           15      // a0 = cwnd, a1 = ssthresh, a2 = CE count
+#define TR_NEVENTS          16
+
+#define TR_F_WND            0x01    // window update
+#define TR_F_RTT            0x02    // ACK carries a RTT sample
+#define TR_F_SPLIT          0x04    // slow start split into congestion avoidance
+#define TR_F_EOF            0x08    // end of file
+#define TR_F_POB            0x10    // window probe
+#define TR_F_DROP           0x20    // ACK dropped by the loss simulation
+                                    // bits 8 ~ 15: # duplicate ACKs
+
+#define TR_TAG_INORDER      0       // reasons of a client ACK
+#define TR_TAG_DELAYED      1
+#define TR_TAG_RWND         2
+#define TR_TAG_OUTOFORDER   3
+#define TR_TAG_PROBE        4
+#define TR_TAG_ZEROWND      5
+#define TR_TAG_INBUF        6
+#define TR_TAG_OUTOFRANGE   7
+#define TR_NTAGS            8
+
+#define TR_RINGSIZE         4096    // records per ring
+#define TR_MAGIC            "UDPFTRC1"
+
+struct tr_header {
+    char        magic[8];           /* TR_MAGIC */
+    uint32_t    recsize;            /* sizeof(struct tr_record) */
+    uint32_t    id;                 /* id of the process */
+};
+
+struct tr_record {
+    uint64_t    ts;                 /* CLOCK_MONOTONIC, in nanoseconds */
+    uint32_t    id;                 /* id of the process */
+    uint16_t    event;              /* TR_* */
+    uint16_t    flags;              /* TR_F_* */
+    uint32_t    arg[4];             /* arguments of the event */
+};
+
+struct tr_ring {
+    uint32_t    head;               /* # records written */
+    uint32_t    tail;               /* # records written to the trace file */
+    struct tr_record rec[TR_RINGSIZE];
+};
+
+// Transfer statistics
+//      Every server session (child) and the client count what happened in
+//      the transfer. With "-M" the counters are written in the Prometheus
+//      text format every ST_INTERVAL milliseconds and at the end, for the
+//      node exporter textfile collector or any local scraper.
+#define ST_RTTMAX           3000    // RTT counted per millisecond up to RTT_RXTMAX
+#define ST_SERIES           1024    // max samples of the cwnd time series
+#define ST_INTERVAL         1000    // export interval, in milliseconds
+
+struct st_sample {
+    uint32_t    t;                  /* ms since the transfer started */
+    uint16_t    cwnd;
+    uint16_t    ssthresh;
+};
+
+struct st_info {
+    char        labels[FILENAME_BUFFSIZE + 128];    /* Prometheus labels */
+    char        server;             /* 1 if server counters are exported */
+    char        done;               /* 1 if the finished transfer is exported */
+    uint64_t    start;              /* start time, in ms */
+    uint64_t    last_export;        /* last export time, in ms */
+    // server
+    uint64_t    bytes_sent;         /* file bytes sent, with retransmissions */
+    uint64_t    dg_sent;            /* data datagrams sent, with retransmissions */
+    uint64_t    dg_resent;          /* data datagrams retransmitted */
+    uint64_t    fast_rexmt;         /* fast retransmissions */
+    uint64_t    timeouts;           /* retransmission timeouts */
+    uint64_t    tail_probes;        /* tail loss probes sent */
+    uint64_t    spurious_rtos;      /* timeouts undone by the timestamp */
+    uint64_t    hystart_exits;      /* slow starts ended by HyStart */
+    uint64_t    ecn_reductions;     /* cwnd reductions for CE marks */
+    uint64_t    acks;               /* ACKs received */
+    uint64_t    dup_acks;           /* duplicate ACKs received */
+    uint64_t    probes;             /* window probes sent */
+    // client
+    uint64_t    bytes_rcvd;         /* file bytes received in order */
+    uint64_t    dg_rcvd;            /* datagrams received */
+    uint64_t    dg_dropped;         /* datagrams discarded by the loss simulation */
+    uint64_t    dg_dup;             /* datagrams already in buffer */
+    uint64_t    dg_ooo;             /* datagrams out of order */
+    uint64_t    dg_outrange;        /* datagrams out of window */
+    uint64_t    dg_ce;              /* datagrams with a CE mark */
+    uint64_t    acks_sent;          /* ACKs sent */
+    uint64_t    acks_dropped;       /* ACKs discarded by the loss simulation */
+    // RTT, in milliseconds
+    uint32_t    rtt_hist[ST_RTTMAX + 1];
+    uint64_t    rtt_n, rtt_sum;
+    uint32_t    rtt_min, rtt_max;
+    // cwnd time series
+    uint16_t    cwnd, ssthresh, cwnd_max;
+    uint32_t    series_n, series_step, series_skip;
+    struct st_sample series[ST_SERIES];
+};
+
+// Impairment relay
+//      dgrelay sits between the client and the server and delays every
+//      datagram in a queue of its direction until its release time. The
+//      port number carried by the first data datagrams is rewritten to a
+//      private port of the relay, so the whole session goes through it.
+//      With a marking threshold, an ECN capable datagram that finds that
+//      many datagrams in the bottleneck queue is marked CE, before the
+//      queue is full and drops it.
+#define RL_MAXSESSIONS      64      // max clients relayed at the same time
+#define RL_IDLE             60      // seconds before an idle session is closed
+#define RL_QUEUELEN         100     // default bottleneck queue, in datagrams
+
+struct rl_packet {
+    uint64_t    release;            /* release time, in microseconds */
+    int         fd;                 /* socket it is sent from */
+    struct sockaddr_in  to;
+    int         len;
+    uint8_t     tos;                /* TOS byte received, with the ECN field */
+    struct rl_packet    *next;
+    char        data[DATAGRAM_PAYLOAD];
+};
+
+struct rl_link {                    /* one direction */
+    char        bad;                /* 1 if the Gilbert-Elliott channel is in the bad state */
+    uint64_t    free_at;            /* time the bottleneck is free, in microseconds */
+    uint64_t    last;               /* release time of the last datagram kept in order */
+    struct rl_packet    *head, *tail;   /* queue sorted by release time */
+    uint64_t    forwarded, lost, queue_drops, reordered, ce_marked;
+};
+
+struct rl_session {
+    char        used;
+    struct sockaddr_in  cli;        /* client address, the same before and after reconnect */
+    struct sockaddr_in  child;      /* server child address, from the port number */
+    int         upfd;               /* socket to the server */
+    int         downfd;             /* private socket to the client, -1 until the port number */
+    time_t      last;               /* last datagram */
+};
+
 // function headers
 extern struct ifi_info *Get_ifi_info_plus(int family, int doaliases);
 extern        void      free_ifi_info_plus(struct ifi_info *ifihead);
 
+void Dg_checkpacket(struct filedatagram *, int);
+void Dg_sendpacket(int, const struct sockaddr *, socklen_t, const struct filedatagram *);
 void Dg_recvpacket(int, struct sockaddr *, socklen_t *, struct filedatagram *);
 
 void Dg_writepacket(int, const struct filedatagram *);
+void Dg_gsomsg(struct msghdr *, struct iovec *, int, char *);
+int Dg_writepacket_gso(int, struct iovec *, int);
 int Dg_readpacket(int, struct filedatagram *);
 int Dg_readpacket_nb(int, struct filedatagram *);
+socklen_t Dg_sp_addr(struct sockaddr_un *, int, uint32_t);
+uint32_t Dg_hash(const char *);
 
 void Dg_cli(int);
 
-void Dg_serv(int, struct socket_info *, struct sockaddr *, struct sockaddr *, char *, int);
+void Dg_serv(int, struct socket_info *, struct sockaddr *, struct sockaddr *, char *, int, int, struct file_cache *, uint32_t);
+
+int Dg_mcast_serv(char *, int, char *, char *, int);
+
+struct file_cache *fc_acquire(char *);
+void fc_release(struct file_cache *);
+
+void pc_init(int);
+int pc_lookup(in_addr_t, struct path_metrics *);
+void pc_update(in_addr_t, const struct path_metrics *);
+
+int ur_init(unsigned);
+void ur_exit();
+int ur_submit(unsigned);
+struct io_uring_sqe *ur_sqe();
+int ur_cqe(uint64_t *, int *);
+
+struct dg_slab *sl_create(size_t, int);
+void sl_destroy(struct dg_slab *);
+void *sl_alloc(struct dg_slab *);
+void sl_free(struct dg_slab *, void *);
+
+void tr_init(char *, uint32_t);
+void tr_flush();
+void tr_event(uint16_t, uint16_t, uint32_t, uint32_t, uint32_t, uint32_t);
+void tr_print(FILE *, const struct tr_record *, char);
+
+extern struct st_info st_xfer;
+void st_init(char *, char *, char *);
+void st_rtt(uint32_t);
+uint32_t st_rtt_pct(int);
+void st_cwnd(uint16_t, uint16_t);
+void st_export(int);
+void st_tick();
 
 void cc_timeout();
 void cc_init(uint16_t, uint16_t);
+void cc_resume(uint16_t);
+void cc_seed(uint16_t, uint16_t);
+void cc_state(uint16_t *, uint16_t *);
 uint16_t cc_wnd();
+uint16_t cc_dupack(uint32_t, uint8_t);
 uint16_t cc_ack(uint32_t, uint16_t, uint8_t, uint8_t*);
+void cc_tailloss(uint8_t*);
+void cc_recovered(uint8_t);
+void cc_hystart(uint32_t, uint32_t, uint32_t, int32_t, uint32_t);
+void cc_ecn(uint32_t, uint32_t, uint16_t);
 
 
 #endif
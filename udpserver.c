@@ -8,11 +8,54 @@
 * Description:  Server C file
 */
 
+#include <sys/random.h>
 #include "udpfile.h"
 
 int port = 0;
 int max_winsize = 0;
-struct process_info *proc_head = NULL, *proc = NULL;
+int chld_pfd[2];
+extern long fc_memcap;
+extern uint8_t gso_enable;
+extern uint8_t ur_enable;
+extern uint8_t ecn_enable;
+extern uint8_t sp_enable;
+extern int pc_prefix;
+extern int pf_windows;
+extern uint8_t sl_hugepage;
+extern int tr_level;
+extern char *tr_prefix;
+extern char *st_dir;
+int route_fd = -1;
+struct process_info *proc_table[PROC_HASHSIZE], *pid_table[PROC_HASHSIZE], *cid_table[PROC_HASHSIZE];
+
+/* --------------------------------------------------------------------------
+ *  usage
+ *
+ *  Print usage
+ *
+ *  @param  : void
+ *  @return : void
+ * --------------------------------------------------------------------------
+ */
+void usage() {
+    printf("Usage: server [-e] [-g] [-u] [-p windows] [-H] [-s] [-c prefix] [-v level] [-T prefix] [-M dir] [-m group:port [-i ifaddr] file] [-h]\n");
+    printf("Options:\n");
+    printf("  -e       do not mark datagrams ECN capable\n");
+    printf("  -g       send datagrams one by one, do not use UDP_SEGMENT\n");
+    printf("  -u       use io_uring for file reads and datagram sends\n");
+    printf("  -p       read-ahead depth in windows (default %d, 0 = disabled)\n", PF_WINDOWS);
+    printf("  -H       back the sender window buffers with huge pages\n");
+    printf("  -s       serve every session on the well-known port, route by connection ID\n");
+    printf("  -c       prefix length of the client networks in the path metrics cache (default %d, 0 = disabled)\n", PC_PREFIX);
+    printf("  -v       console verbosity: 0 quiet, 1 retransmissions, 2 every datagram (default)\n");
+    printf("  -T       write a binary event trace of every child to prefix.<pid>\n");
+    printf("  -M       export the statistics of every child to dir/udpfile_<pid>.prom\n");
+    printf("  -m       multicast the file to group:port instead of serving requests\n");
+    printf("  -i       outgoing interface address for multicast\n");
+    printf("  -h       display this help\n");
+
+    exit(0);
+}
 
 /* --------------------------------------------------------------------------
  *  readArguments
@@ -26,14 +69,18 @@ struct process_info *proc_head = NULL, *proc = NULL;
  *  Read arguments from "server.in"
  *    Line 1: <INTEGER>     -> int port
  *    Line 2: <INTEGER>     -> int max_winsize
+ *    Line 3: <INTEGER>     -> long fc_memcap (in MB, optional)
  * --------------------------------------------------------------------------
  */
 void readArguments() {
     FILE *fp;
+    long memcap;
     fp = Fopen("server.in", "rt");
     fscanf(fp, "%d", &port);
     fscanf(fp, "%d", &max_winsize);
-    printf("[server.in] port=%d, max_winsize=%d\n", port, max_winsize);
+    if (fscanf(fp, "%ld", &memcap) == 1 && memcap >= 0)
+        fc_memcap = memcap * 1024 * 1024;
+    printf("[server.in] port=%d, max_winsize=%d, fc_memcap=%ldMB\n", port, max_winsize, fc_memcap / 1024 / 1024);
     Fclose(fp);
 }
 
@@ -99,6 +146,113 @@ int bind_sockets(struct socket_info **sock_list) {
     return maxfd;
 }
 
+/* --------------------------------------------------------------------------
+ *  hashRequest
+ *
+ *  File request hash function
+ *
+ *  @param  : in_addr_t address
+ *            int       port
+ *            uint32_t  fhash
+ *  @return : uint32_t  # bucket index in proc_table
+ *
+ *  # This is a static inline function
+ *  Mix client address, client port and filename hash into one bucket index
+ * --------------------------------------------------------------------------
+ */
+static inline uint32_t hashRequest(in_addr_t address, int port, uint32_t fhash) {
+    uint32_t h = fhash;
+
+    h ^= (uint32_t)address + 0x9e3779b9u + (h << 6) + (h >> 2);
+    h ^= (uint32_t)port + 0x9e3779b9u + (h << 6) + (h >> 2);
+    return h & (PROC_HASHSIZE - 1);
+}
+
+/* --------------------------------------------------------------------------
+ *  addProcess
+ *
+ *  Register a child process
+ *
+ *  @param  : pid_t     pid
+ *            char      *filename
+ *            in_addr_t address
+ *            int       port
+ *            struct file_cache *cache
+ *            uint32_t  cid
+ *  @return : void
+ *  @see    : struct#process_info
+ *
+ *  Save the pid, filename, client IP, port, the cached file used by the
+ *  child and the connection ID to process_info and link it into the
+ *  request, pid and connection ID hash chains
+ * --------------------------------------------------------------------------
+ */
+void addProcess(pid_t pid, char *filename, in_addr_t address, int port, struct file_cache *cache, uint32_t cid) {
+    uint32_t h;
+    struct process_info *proc;
+
+    proc = Malloc(sizeof(struct process_info));
+    bzero(proc, sizeof(*proc));
+    proc->pid = pid;
+    snprintf(proc->filename, sizeof(proc->filename), "%s", filename);
+    proc->address = address;
+    proc->port = port;
+    proc->fhash = Dg_hash(filename);
+    proc->cache = cache;
+    proc->cid = cid;
+
+    h = hashRequest(address, port, proc->fhash);
+    proc->next = proc_table[h];
+    proc_table[h] = proc;
+
+    h = pid & (PROC_HASHSIZE - 1);
+    proc->pnext = pid_table[h];
+    pid_table[h] = proc;
+
+    h = cid & (PROC_HASHSIZE - 1);
+    proc->cnext = cid_table[h];
+    cid_table[h] = proc;
+}
+
+/* --------------------------------------------------------------------------
+ *  removeProcess
+ *
+ *  Unregister a child process
+ *
+ *  @param  : pid_t     pid
+ *  @return : void
+ *  @see    : struct#process_info
+ *
+ *  Find the entry through the pid hash chain, unlink it from all chains,
+ *  release the cached file and free it
+ * --------------------------------------------------------------------------
+ */
+void removeProcess(pid_t pid) {
+    struct process_info **pp, *proc;
+
+    for (pp = &pid_table[pid & (PROC_HASHSIZE - 1)]; *pp != NULL; pp = &(*pp)->pnext)
+        if ((*pp)->pid == pid)
+            break;
+    if ((proc = *pp) == NULL)
+        return;
+    *pp = proc->pnext;
+
+    for (pp = &proc_table[hashRequest(proc->address, proc->port, proc->fhash)]; *pp != NULL; pp = &(*pp)->next)
+        if (*pp == proc) {
+            *pp = proc->next;
+            break;
+        }
+
+    for (pp = &cid_table[proc->cid & (PROC_HASHSIZE - 1)]; *pp != NULL; pp = &(*pp)->cnext)
+        if (*pp == proc) {
+            *pp = proc->cnext;
+            break;
+        }
+
+    fc_release(proc->cache);
+    free(proc);
+}
+
 /* --------------------------------------------------------------------------
  *  sig_chld
  *
@@ -106,37 +260,48 @@ int bind_sockets(struct socket_info **sock_list) {
  *
  *  @param  : int signo
  *  @return : void
- *  @see    : struct#process_info
+ *  @see    : function#reapChildren
  *
  *  Catch SIGCHLD signal
- *  Remove the items in process_info structure and terminate all the zombie
- *  children
+ *  Write one byte to the pipe, inform select() that there are children to
+ *  reap. The process_info tables are only touched outside signal context.
  * --------------------------------------------------------------------------
  */
 void sig_chld(int signo) {
+    int     saved_errno = errno;
+    char    c = 0;
+
+    write(chld_pfd[1], &c, 1);
+    errno = saved_errno;
+}
+
+/* --------------------------------------------------------------------------
+ *  reapChildren
+ *
+ *  Terminated children handler
+ *
+ *  @param  : void
+ *  @return : void
+ *  @see    : function#removeProcess
+ *
+ *  Remove the items in process_info structure and terminate all the zombie
+ *  children. The pipe is drained first, one waitpid loop reaps the
+ *  children of all the bytes.
+ * --------------------------------------------------------------------------
+ */
+void reapChildren() {
     pid_t   pid;
     int     stat;
-    struct process_info *proc_prev = NULL;
+    char    buf[64];
+
+    while (read(chld_pfd[0], buf, sizeof(buf)) > 0)
+        ;
 
     while ((pid = waitpid(-1, &stat, WNOHANG)) > 0) {
         // remove the entry from process_info
-        proc = proc_head;
-        while (proc != NULL) {
-            if (proc->pid == pid) {
-                if (proc == proc_head)
-                    proc_head = proc->next;
-                else
-                    proc_prev->next = proc->next;
-                free(proc);
-                break;
-            }
-            proc_prev = proc;
-            proc = proc->next;
-        }
-
+        removeProcess(pid);
         printf("[Server]: Child %d terminated.\n", pid);
     }
-    return;
 }
 
 /* --------------------------------------------------------------------------
@@ -144,26 +309,255 @@ void sig_chld(int signo) {
  *
  *  File request check function
  *
- *  @param  : char  *filename
- *            char  *address
- *            int   port
+ *  @param  : char      *filename
+ *            in_addr_t address
+ *            int       port
  *  @return : int   # 0 if the request is new
  *                  # otherwise, return the process id
  *
  *  Check if the file request is already handled by a child process
+ *  Only the entries in the same request hash bucket are compared
  * --------------------------------------------------------------------------
  */
-int checkProcess(char *filename, char *address, int port) {
-    proc = proc_head;
+int checkProcess(char *filename, in_addr_t address, int port) {
+    uint32_t fhash = Dg_hash(filename);
+    struct process_info *proc;
 
-    while (proc != NULL) {
-        if ((strcmp(proc->filename, filename) == 0) && (strcmp(proc->address, address) == 0) && proc->port == port)
+    for (proc = proc_table[hashRequest(address, port, fhash)]; proc != NULL; proc = proc->next)
+        if (proc->fhash == fhash && proc->address == address && proc->port == port && strcmp(proc->filename, filename) == 0)
             return proc->pid;
-        proc = proc->next;
-    }
     return 0;
 }
 
+/* --------------------------------------------------------------------------
+ *  findSession
+ *
+ *  Connection ID lookup function
+ *
+ *  @param  : uint32_t  cid
+ *  @return : struct process_info * # NULL if no child serves the session
+ *
+ *  Find the entry through the connection ID hash chain
+ * --------------------------------------------------------------------------
+ */
+struct process_info *findSession(uint32_t cid) {
+    struct process_info *proc;
+
+    for (proc = cid_table[cid & (PROC_HASHSIZE - 1)]; proc != NULL; proc = proc->cnext)
+        if (proc->cid == cid)
+            return proc;
+    return NULL;
+}
+
+/* --------------------------------------------------------------------------
+ *  newSession
+ *
+ *  Connection ID allocation function
+ *
+ *  @param  : void
+ *  @return : uint32_t  # a random nonzero connection ID not in use
+ * --------------------------------------------------------------------------
+ */
+uint32_t newSession() {
+    uint32_t cid;
+
+    do {
+        if (getrandom(&cid, sizeof(cid), 0) != sizeof(cid))
+            err_sys("getrandom error");
+    } while (cid == 0 || findSession(cid) != NULL);
+    return cid;
+}
+
+/* --------------------------------------------------------------------------
+ *  routeSession
+ *
+ *  Single-port mode datagram routing function
+ *
+ *  @param  : struct sockaddr_in    *from
+ *            struct filedatagram   *datagram
+ *  @return : int   # 1 if the datagram is routed to a child
+ *  @see    : struct#sp_forward
+ *
+ *  A datagram of a running session that reaches the listening socket came
+ *  from another client address than the one the child is connected to.
+ *  Send it with the new address to the unix socket of the child.
+ * --------------------------------------------------------------------------
+ */
+int routeSession(struct sockaddr_in *from, struct filedatagram *datagram) {
+    struct process_info *proc;
+    struct sp_forward   fw;
+    struct sockaddr_un  sun;
+    socklen_t           len;
+
+    if (route_fd < 0 || datagram->cid == 0 || (proc = findSession(datagram->cid)) == NULL)
+        return 0;
+
+    memcpy(&fw.from, from, sizeof(fw.from));
+    memcpy(&fw.datagram, datagram, DATAGRAM_HEADERSIZE + datagram->len);
+    len = Dg_sp_addr(&sun, port, proc->cid);
+    if (sendto(route_fd, &fw, sizeof(fw.from) + DATAGRAM_HEADERSIZE + datagram->len, MSG_DONTWAIT, (SA *)&sun, len) < 0)
+        return 0;
+    printf("[Server]: Routed a datagram of session %08x (child #%d) from %s:%d.\n",
+        proc->cid, proc->pid, inet_ntoa(from->sin_addr), ntohs(from->sin_port));
+    return 1;
+}
+
+/* --------------------------------------------------------------------------
+ *  closeSession
+ *
+ *  FIN of a closed session
+ *
+ *  @param  : int                   sockfd
+ *            struct sockaddr       *from
+ *            socklen_t             len
+ *            struct filedatagram   *datagram
+ *  @return : void
+ *
+ *  In single-port mode the resent FIN of a session whose child has exited
+ *  reaches the listening socket. The child only exits after its FIN-ACK,
+ *  so answer with a FIN-ACK again.
+ * --------------------------------------------------------------------------
+ */
+void closeSession(int sockfd, struct sockaddr *from, socklen_t len, struct filedatagram *datagram) {
+    struct filedatagram fin;
+
+    bzero(&fin, DATAGRAM_HEADERSIZE);
+    fin.ack = datagram->ack;
+    fin.cid = datagram->cid;
+    fin.flag.fin = 1;
+    Dg_sendpacket(sockfd, from, len, &fin);
+    printf("[Server]: Received FIN of closed session %08x, send FIN-ACK.\n", datagram->cid);
+}
+
+/* --------------------------------------------------------------------------
+ *  openSession
+ *
+ *  Single-port session socket function
+ *
+ *  @param  : struct socket_info    *sock       # listening socket of the request
+ *            struct sockaddr       *client
+ *            struct sp_forward     *queued     # datagrams of other clients
+ *            int                   *nqueued    # # datagrams in queued
+ *  @return : int   # socket on the well-known port, connected to the client
+ *
+ *  The socket of the child is bound and connected by the parent before
+ *  the fork: bound but not connected, it is one more socket listening on
+ *  the well-known port, and the kernel prefers the newest one, so the
+ *  requests of other clients would reach the child. The datagrams that
+ *  got there in between are drained (at most SP_DRAIN), the parent
+ *  handles them as if they reached the listening socket.
+ * --------------------------------------------------------------------------
+ */
+int openSession(struct socket_info *sock, struct sockaddr *client, struct sp_forward *queued, int *nqueued) {
+    const int   on = 1;
+    int         sockfd, n;
+    socklen_t   len;
+
+    sockfd = Socket(AF_INET, SOCK_DGRAM, 0);
+    Setsockopt(sockfd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+    Bind(sockfd, sock->addr, sizeof(struct sockaddr_in));
+    Connect(sockfd, client, sizeof(struct sockaddr_in));
+
+    for (*nqueued = 0; *nqueued < SP_DRAIN; ) {
+        bzero(&queued[*nqueued], sizeof(queued[*nqueued]));
+        len = sizeof(queued[*nqueued].from);
+        n = recvfrom(sockfd, &queued[*nqueued].datagram, DATAGRAM_PAYLOAD, MSG_DONTWAIT, (SA *)&queued[*nqueued].from, &len);
+        if (n < 0)
+            break;
+        Dg_checkpacket(&queued[*nqueued].datagram, n);
+        (*nqueued) ++;
+    }
+
+    return sockfd;
+}
+
+/* --------------------------------------------------------------------------
+ *  handleDatagram
+ *
+ *  Datagram handler of the listening sockets
+ *
+ *  @param  : struct socket_info    *sock       # listening socket it reached
+ *            struct socket_info    *sock_head
+ *            struct sockaddr       *from
+ *            socklen_t             len
+ *            struct filedatagram   *datagram
+ *  @return : void
+ *
+ *  A file request forks a child for the session, a FIN of a closed session
+ *  is answered, a datagram of a running session is routed to its child
+ * --------------------------------------------------------------------------
+ */
+void handleDatagram(struct socket_info *sock, struct socket_info *sock_head, struct sockaddr *from, socklen_t len, struct filedatagram *datagram) {
+    pid_t       childpid;
+    struct file_cache   *cache;
+    struct sp_forward   queued[SP_DRAIN];
+    int         spfd = -1, nqueued = 0, i, n;
+    uint32_t    cid;
+    char        filename[FILENAME_BUFFSIZE];
+
+    // check the packet contains a filename
+    if (datagram->flag.fln == 1) {
+        struct sockaddr_in *clientaddr_in = (struct sockaddr_in *)from;
+
+        // the filename is not terminated in the datagram
+        n = min(datagram->len, FILENAME_BUFFSIZE - 1);
+        memcpy(filename, datagram->data, n);
+        filename[n] = 0;
+
+        if (isatty(fileno(stdout)))
+            printf("[Server]: Received a valid file request \"%s\" from client \x1B[0;33m%s:%d\x1B[0;0m to server \x1B[0;33m%s:%d\x1B[0;0m\n",
+                filename,
+                Sock_ntop_host(from, len), clientaddr_in->sin_port,
+                Sock_ntop_host(sock->addr, sizeof(*(sock->addr))), port);
+        else
+            printf("[Server]: Received a valid file request \"%s\" from client %s:%d to server %s:%d\n",
+                filename,
+                Sock_ntop_host(from, len), clientaddr_in->sin_port,
+                Sock_ntop_host(sock->addr, sizeof(*(sock->addr))), port);
+
+        // check if the file request already handled
+        childpid = checkProcess(filename, clientaddr_in->sin_addr.s_addr, clientaddr_in->sin_port);
+        if (childpid > 0) {
+            printf("[Server]: A duplicate file request already handled by child #%d.\n", childpid);
+            return;
+        }
+
+        // map the file (or share the cached mapping) before fork
+        cache = fc_acquire(filename);
+        cid = newSession();
+
+        // single-port mode: the socket of the child is ready before fork
+        if (sp_enable)
+            spfd = openSession(sock, from, queued, &nqueued);
+
+        childpid = Fork();
+        if (childpid == 0) {
+            // this is child process part
+            close(chld_pfd[0]);
+            close(chld_pfd[1]);
+            if (route_fd >= 0)
+                close(route_fd);
+            Dg_serv(spfd, sock_head, sock->addr, from, filename, max_winsize, datagram->wnd, cache, cid);
+            exit(0);
+        }
+
+        // this is parent process part
+
+        // save the pid, filename, client IP, port and cid to process_info
+        addProcess(childpid, filename, clientaddr_in->sin_addr.s_addr, clientaddr_in->sin_port, cache, cid);
+
+        if (spfd >= 0)
+            close(spfd);
+        for (i = 0; i < nqueued; i++)
+            handleDatagram(sock, sock_head, (SA *)&queued[i].from, sizeof(queued[i].from), &queued[i].datagram);
+    } else if (datagram->flag.fin == 1 && datagram->cid != 0 && findSession(datagram->cid) == NULL) {
+        // the child has closed the session, its FIN-ACK was lost
+        closeSession(sock->sockfd, from, len, datagram);
+    } else if (routeSession((struct sockaddr_in *)from, datagram) == 0) {
+        printf("[Server]: Received an invalid packet (no filename requested).\n");
+    }
+}
+
 /* --------------------------------------------------------------------------
  *  main
  *
@@ -179,13 +573,70 @@ int checkProcess(char *filename, char *address, int port) {
  */
 int main(int argc, char **argv) {
     int         maxfdp1 = -1, r, len;
-    pid_t       childpid;
     fd_set      rset;
     struct socket_info  *sock_head = NULL, *sock = NULL;
     struct sockaddr     clientfrom;
     struct filedatagram datagram;
+    char        *mcast = NULL, *mcast_if = NULL, *mcast_port;
+    int         c;
+
+    while ((c = getopt(argc, argv, "egup:Hsc:v:T:M:m:i:h?")) != -1) {
+        switch (c) {
+        case 'e':
+            ecn_enable = 0;
+            break;
+        case 'g':
+            gso_enable = 0;
+            break;
+        case 'u':
+            ur_enable = 1;
+            break;
+        case 'p':
+            pf_windows = atoi(optarg);
+            if (pf_windows < 0)
+                usage();
+            break;
+        case 'H':
+            sl_hugepage = 1;
+            break;
+        case 's':
+            sp_enable = 1;
+            break;
+        case 'c':
+            pc_prefix = atoi(optarg);
+            if (pc_prefix < 0 || pc_prefix > 32)
+                usage();
+            break;
+        case 'v':
+            tr_level = atoi(optarg);
+            break;
+        case 'T':
+            tr_prefix = optarg;
+            break;
+        case 'M':
+            st_dir = optarg;
+            break;
+        case 'm':
+            mcast = optarg;
+            break;
+        case 'i':
+            mcast_if = optarg;
+            break;
+        default:
+            usage();
+            break;
+        }
+    }
 
     readArguments();
+
+    // multicast distribution mode: one sender for all receivers
+    if (mcast) {
+        if (optind >= argc || (mcast_port = strchr(mcast, ':')) == NULL)
+            usage();
+        *mcast_port++ = 0;
+        exit(Dg_mcast_serv(mcast, atoi(mcast_port), mcast_if, argv[optind], max_winsize) == 1 ? 0 : 1);
+    }
     maxfdp1 = bind_sockets(&sock_head) + 1;
 
     // print out the binding information
@@ -197,15 +648,28 @@ int main(int argc, char **argv) {
         printf("]\n");
     }
 
-    // use function sig_chld as SIGCHLD handler, function sig_int as SIGINT handler
+    // use function sig_chld as SIGCHLD handler, it informs select() via pipe
+    // (non-blocking, a full pipe must not block the handler)
+    Pipe(chld_pfd);
+    Fcntl(chld_pfd[0], F_SETFL, Fcntl(chld_pfd[0], F_GETFL, 0) | O_NONBLOCK);
+    Fcntl(chld_pfd[1], F_SETFL, Fcntl(chld_pfd[1], F_GETFL, 0) | O_NONBLOCK);
+    maxfdp1 = max(maxfdp1, chld_pfd[0] + 1);
     Signal(SIGCHLD, sig_chld);
 
+    // path metrics shared by all children
+    pc_init(pc_prefix);
+
+    // the socket routing datagrams to the children
+    if (sp_enable)
+        route_fd = Socket(AF_LOCAL, SOCK_DGRAM, 0);
+
     FD_ZERO(&rset);
     len = sizeof(clientfrom);
     for ( ; ; ) {
         // use select() to monitor all listening sockets
         for (sock = sock_head; sock != NULL; sock = sock->next)
             FD_SET(sock->sockfd, &rset);
+        FD_SET(chld_pfd[0], &rset);
 
         // need to use select rather than Select provided by Steven
         // cos Steven's Select doesn't handle EINTR
@@ -215,6 +679,10 @@ int main(int argc, char **argv) {
         if (r == -1 && errno == EINTR)
             continue;
 
+        // reap terminated children
+        if (FD_ISSET(chld_pfd[0], &rset))
+            reapChildren();
+
         // handle the readable socket
         for (sock = sock_head; sock != NULL; sock = sock->next) {
             if (FD_ISSET(sock->sockfd, &rset)) {
@@ -222,49 +690,7 @@ int main(int argc, char **argv) {
                 // fill the packet datagram
                 bzero(&datagram, sizeof(datagram));
                 Dg_recvpacket(sock->sockfd, &clientfrom, &len, &datagram);
-
-                // check the packet contains a filename
-                if (datagram.flag.fln == 1) {
-                    struct sockaddr_in *clientaddr_in = (struct sockaddr_in *)&clientfrom;
-                    if (isatty(fileno(stdout)))
-                        printf("[Server]: Received a valid file request \"%s\" from client \x1B[0;33m%s:%d\x1B[0;0m to server \x1B[0;33m%s:%d\x1B[0;0m\n",
-                            datagram.data,
-                            Sock_ntop_host(&clientfrom, len), clientaddr_in->sin_port,
-                            Sock_ntop_host(sock->addr, sizeof(*(sock->addr))), port);
-                    else
-                        printf("[Server]: Received a valid file request \"%s\" from client %s:%d to server %s:%d\n",
-                            datagram.data,
-                            Sock_ntop_host(&clientfrom, len), clientaddr_in->sin_port,
-                            Sock_ntop_host(sock->addr, sizeof(*(sock->addr))), port);
-
-                    // check if the file request already handled
-                    childpid = checkProcess(datagram.data, Sock_ntop_host(&clientfrom, len), clientaddr_in->sin_port);
-                    if (childpid > 0) {
-                        printf("[Server]: A duplicate file request already handled by child #%d.\n", childpid);
-                        continue;
-                    }
-
-                    childpid = Fork();
-                    if (childpid == 0) {
-                        // this is child process part
-                        Dg_serv(sock->sockfd, sock_head, sock->addr, &clientfrom, datagram.data, max_winsize);
-                        exit(0);
-                    } else {
-                        // this is parent process part
-
-                        // save the pid, filename, client IP and port to process_info
-                        proc = Malloc(sizeof(struct process_info));
-                        bzero(proc, sizeof(*proc));
-                        proc->pid = childpid;
-                        strcpy(proc->filename, datagram.data);
-                        strcpy(proc->address, Sock_ntop_host(&clientfrom, len));
-                        proc->port = clientaddr_in->sin_port;
-                        proc->next = proc_head;
-                        proc_head = proc;
-                    }
-                } else {
-                    printf("[Server]: Received an invalid packet (no filename requested).\n");
-                }
+                handleDatagram(sock, sock_head, &clientfrom, len, &datagram);
                 continue;
             }
         }
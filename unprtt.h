@@ -14,18 +14,25 @@ struct rtt_info {
     uint32_t    rtt_rto;    /* current RTO to use, in milliseconds */
     uint32_t    rtt_nrexmt; /* # times retransmitted: 0, 1, 2, ... */
     uint32_t    rtt_base;   /* # sec since 1/1/1970 at start */
+    uint32_t    rtt_nsample;/* # RTT measurements (or a seed) */
+    uint32_t    rtt_minrtt; /* min RTT of the last RTT_MINWIN, in milliseconds */
+    uint32_t    rtt_minstamp;   /* timestamp of rtt_minrtt */
 };
 
 #define RTT_RXTMIN      1000    /* min retransmit timeout value, in milliseconds */
 #define RTT_RXTMAX      3000    /* max retransmit timeout value, in milliseconds */
 #define RTT_MAXNREXMT   12      /* max # times to retransmit */
+#define RTT_PTOMIN      10      /* min tail loss probe timeout, in milliseconds */
+#define RTT_MINWIN      10000   /* window of the min RTT, in milliseconds */
 
 /* function prototypes */
 void        rtt_init(struct rtt_info *);
 void        rtt_newpack(struct rtt_info *);
 uint32_t    rtt_start(struct rtt_info *);
 void        rtt_stop(struct rtt_info *, uint32_t);
+void        rtt_seed(struct rtt_info *, uint32_t, uint32_t);
 int         rtt_timeout(struct rtt_info *);
+uint32_t    rtt_pto(struct rtt_info *);
 uint32_t    rtt_ts(struct rtt_info *);
 
 #endif /* __unp_rtt_h */